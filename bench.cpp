@@ -0,0 +1,216 @@
+// Benchmarks for the hot paths of days, run on synthetic events.
+// Build and run with `make bench && ./bench [rows]`.
+
+#include <iostream>  // for standard I/O streams
+#include <iomanip>   // for stream control
+#include <string>    // for std::string class
+#include <vector>    // for std::vector class
+#include <chrono>    // for timing
+#include <random>    // for generating the events
+#include <functional> // for std::function
+#include <algorithm> // for std::stable_sort
+#include <unordered_map> // for the baseline of the category lookups
+
+#include "event.h"   // for our Event class
+#include "filter.h"  // for --where expressions
+#include "kernels.h" // for the specialized filter scans
+#include "perfecthash.h" // for the category dictionary
+
+// Makes `count` events spread over 30 years with a handful of categories, the
+// way a long-lived calendar looks.
+std::vector<Event> makeEvents(std::size_t count)
+{
+    const std::vector<std::string> categories{"work", "home", "garden", "", "sport", "family", "travel", "health"};
+    const std::vector<std::string> verbs{"deploy", "meeting", "call", "visit", "review", "dinner", "trip", "checkup"};
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> day(0, 30 * 365);
+    std::uniform_int_distribution<std::size_t> category(0, categories.size() - 1);
+    std::uniform_int_distribution<std::size_t> verb(0, verbs.size() - 1);
+    std::uniform_int_distribution<int> number(0, 99999);
+
+    const std::chrono::sys_days start{std::chrono::year{2000} / 1 / 1};
+    std::vector<Event> events;
+    events.reserve(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        events.emplace_back(
+            std::chrono::year_month_day{start + std::chrono::days{day(random)}},
+            categories[category(random)],
+            verbs[verb(random)] + " " + std::to_string(number(random)));
+    }
+    return events;
+}
+
+// Returns the best time of `runs` calls to `body`, in milliseconds.
+double getBestMilliseconds(int runs, const std::function<void()> &body)
+{
+    double best = 1e300;
+    for (int i = 0; i < runs; i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+// Compares the specialized scan kernels with the bytecode interpreter.
+void benchmarkFilters(const EventColumns &columns)
+{
+    const std::vector<std::string> expressions{
+        "date >= 2010-01-01 and date < 2020-01-01",
+        "date >= 2010-01-01 and date < 2020-01-01 and category in (work, home)",
+        "category in (work, home, garden) and description ^= \"deploy\"",
+        "date >= 2015-06-01 and category = travel and description ^= \"trip 1\"",
+        "category = work or category = home",
+    };
+
+    std::cout << "filter scans over " << columns.size() << " rows (best of 5, ms)" << std::endl;
+    std::cout << std::setw(10) << "generic" << std::setw(10) << "kernel" << std::setw(9) << "speedup" << "  expression" << std::endl;
+    for (const auto &expression : expressions)
+    {
+        std::string error;
+        const auto filter = Filter::compile(expression, error);
+        if (!filter.has_value())
+        {
+            std::cerr << expression << ": " << error << std::endl;
+            continue;
+        }
+
+        std::vector<std::uint32_t> generic;
+        std::vector<std::uint32_t> specialized;
+        const double genericTime = getBestMilliseconds(5, [&]()
+                                                       { generic = scanGeneric(columns, filter.value()); });
+        const double kernelTime = getBestMilliseconds(5, [&]()
+                                                      { specialized = scan(columns, filter.value()).value(); });
+        if (generic != specialized)
+            std::cerr << "MISMATCH: " << expression << std::endl;
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(10) << genericTime << std::setw(10) << kernelTime
+                  << std::setw(8) << genericTime / kernelTime << "x"
+                  << "  " << expression
+                  << (getScanShape(filter.value()).has_value() ? "" : " (no kernel)") << std::endl;
+    }
+}
+
+// Compares resolving categories to ids with the perfect hash of the category
+// dictionary and with a std::unordered_map, for dictionaries of a few to many
+// categories. A tenth of the lookups are for categories that aren't there.
+void benchmarkCategoryLookups(std::size_t lookups)
+{
+    std::cout << "category lookups, " << lookups << " per run (best of 5, ms)" << std::endl;
+    std::cout << std::setw(10) << "keys" << std::setw(10) << "map" << std::setw(10) << "perfect" << std::setw(9) << "speedup"
+              << std::setw(10) << "build" << "  bytes/key" << std::endl;
+    std::mt19937 random(7);
+    for (const std::size_t count : {8, 64, 1000, 100000})
+    {
+        std::vector<std::string> keys;
+        for (std::size_t i = 0; i < count; i++)
+            keys.push_back((i % 3 == 0 ? "cat" : i % 3 == 1 ? "team-meetings-" : "f") + std::to_string(i));
+        // The queries are few enough to stay in the cache, so that the lookups
+        // are timed rather than the reading of the queries.
+        std::vector<std::string> queries;
+        std::uniform_int_distribution<std::size_t> pick(0, count - 1);
+        for (std::size_t i = 0; i < 4096; i++)
+            queries.push_back(i % 10 == 9 ? "missing" + std::to_string(i) : keys[pick(random)]);
+
+        std::unordered_map<std::string, int> map;
+        for (std::size_t i = 0; i < count; i++)
+            map.emplace(keys[i], static_cast<int>(i));
+        PerfectHash function;
+        const double buildTime = getBestMilliseconds(1, [&]()
+                                                     { function = PerfectHash::build(std::vector<std::string_view>(keys.begin(), keys.end())); });
+
+        std::size_t mapFound = 0;
+        std::size_t functionFound = 0;
+        const double mapTime = getBestMilliseconds(5, [&]()
+                                                   {
+            mapFound = 0;
+            for (std::size_t i = 0; i < lookups; i++)
+                mapFound += map.find(queries[i % queries.size()]) != map.end(); });
+        const double functionTime = getBestMilliseconds(5, [&]()
+                                                        {
+            functionFound = 0;
+            for (std::size_t i = 0; i < lookups; i++)
+                functionFound += function.find(queries[i % queries.size()]).has_value(); });
+        if (mapFound != functionFound)
+            std::cerr << "MISMATCH: " << count << " keys" << std::endl;
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(10) << count << std::setw(10) << mapTime << std::setw(10) << functionTime
+                  << std::setw(8) << mapTime / functionTime << "x" << std::setw(10) << buildTime
+                  << std::setw(11) << static_cast<double>(function.getFunctionBytes()) / count << std::endl;
+    }
+}
+
+// Compares running a nightly report's worth of queries one scan each with
+// running them together in one shared scan. `order` names the order of the events.
+void benchmarkSharedScan(const EventColumns &columns, std::size_t queryCount, const std::string &order)
+{
+    const std::vector<std::string> categories{"work", "home", "garden", "sport", "family", "travel", "health"};
+    const std::vector<std::string> verbs{"deploy", "meeting", "call", "visit", "review", "dinner", "trip", "checkup"};
+    std::vector<QueryPlan> plans;
+    for (std::size_t i = 0; i < queryCount; i++)
+    {
+        const std::string year = std::to_string(2000 + i % 30);
+        const std::string &category = categories[i % categories.size()];
+        const std::string &verb = verbs[i / categories.size() % verbs.size()];
+        std::string expression;
+        switch (i % 4)
+        {
+        case 0: expression = "date >= " + year + "-01-01 and date < " + year + "-07-01 and category = " + category; break;
+        case 1: expression = "category = " + category + " and description ^= \"" + verb + "\""; break;
+        case 2: expression = "date >= " + year + "-03-01 and description ^= \"" + verb + " 1\""; break;
+        default: expression = "category = " + category + " or description ^= \"" + verb + " 9\""; break;
+        }
+        std::string error;
+        auto filter = Filter::compile(expression, error);
+        if (!filter.has_value())
+        {
+            std::cerr << expression << ": " << error << std::endl;
+            return;
+        }
+        plans.emplace_back(std::move(filter.value()));
+    }
+    std::vector<const QueryPlan *> pointers;
+    for (const auto &plan : plans)
+        pointers.push_back(&plan);
+
+    std::vector<std::vector<std::uint32_t>> separate(plans.size());
+    std::vector<std::vector<std::uint32_t>> shared;
+    const double separateTime = getBestMilliseconds(3, [&]()
+                                                    {
+        for (std::size_t i = 0; i < plans.size(); i++)
+            separate[i] = scan(columns, plans[i]).value(); });
+    const double sharedTime = getBestMilliseconds(3, [&]()
+                                                  { shared = scanShared(columns, pointers).value(); });
+    if (separate != shared)
+        std::cerr << "MISMATCH: shared scan" << std::endl;
+
+    std::cout << std::fixed << std::setprecision(2)
+              << std::setw(10) << separateTime << std::setw(10) << sharedTime
+              << std::setw(8) << separateTime / sharedTime << "x  " << order << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    const std::size_t rows = argc > 1 ? std::stoul(argv[1]) : 2000000;
+    const auto events = makeEvents(rows);
+    const auto columns = EventColumns::of(events);
+
+    benchmarkFilters(columns);
+    benchmarkCategoryLookups(rows);
+
+    // days keeps the events in date order, which lets the shared scan skip blocks.
+    constexpr std::size_t queryCount = 200;
+    std::cout << queryCount << " queries over " << columns.size() << " rows (best of 3, ms)" << std::endl;
+    std::cout << std::setw(10) << "separate" << std::setw(10) << "shared" << std::setw(9) << "speedup" << "  events" << std::endl;
+    benchmarkSharedScan(columns, queryCount, "in random order");
+    auto sortedEvents = events;
+    std::stable_sort(sortedEvents.begin(), sortedEvents.end(), [](const Event &a, const Event &b)
+                     { return getMinuteNumber(a) < getMinuteNumber(b); });
+    benchmarkSharedScan(EventColumns::of(sortedEvents), queryCount, "in date order");
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "capture.h"
+
+#include <charconv>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "event.h"
+
+namespace {
+
+void appendEscaped(std::string& line, const std::string& word) {
+    for (char c : word) {
+        if (c == '\t') {
+            line += "\\t";
+        } else if (c == '\n') {
+            line += "\\n";
+        } else if (c == '\\') {
+            line += "\\\\";
+        } else {
+            line += c;
+        }
+    }
+}
+
+// Splits `line` at the tabs and undoes the escaping of each field.
+std::vector<std::string> splitFields(const std::string& line) {
+    std::vector<std::string> fields(1);
+    for (std::size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '\t') {
+            fields.emplace_back();
+        } else if (line[i] == '\\' && i + 1 < line.size()) {
+            const char next = line[++i];
+            fields.back() += next == 't' ? '\t' : next == 'n' ? '\n' : next;
+        } else {
+            fields.back() += line[i];
+        }
+    }
+    return fields;
+}
+
+}
+
+bool appendCapturedCommand(const std::filesystem::path& path, const CapturedCommand& command) {
+    std::string line = getStringFromDate(std::chrono::year_month_day{command.today});
+    line += '\t';
+    line += std::to_string(command.elapsed.count());
+    for (const auto& word : command.words) {
+        line += '\t';
+        appendEscaped(line, word);
+    }
+    line += '\n';
+
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const bool written = write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size());
+    close(fd);
+    return written;
+}
+
+std::optional<CapturedCommand> parseCapturedCommand(const std::string& line) {
+    auto fields = splitFields(line);
+    if (fields.size() < 3) {
+        return std::nullopt;
+    }
+    const auto date = getDateFromString(fields[0]);
+    long long elapsed = 0;
+    const auto* end = fields[1].data() + fields[1].size();
+    const auto [rest, error] = std::from_chars(fields[1].data(), end, elapsed);
+    if (!date.has_value() || error != std::errc{} || rest != end) {
+        return std::nullopt;
+    }
+    return CapturedCommand{std::chrono::sys_days{date.value()}, std::chrono::microseconds{elapsed},
+                           std::vector<std::string>(std::make_move_iterator(fields.begin() + 2),
+                                                    std::make_move_iterator(fields.end()))};
+}
+
+std::optional<std::vector<CapturedCommand>> readCapturedCommands(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return std::nullopt;
+    }
+    std::vector<CapturedCommand> commands;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (auto command = parseCapturedCommand(line); command.has_value()) {
+            commands.push_back(std::move(command.value()));
+        }
+    }
+    return commands;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// A log of the commands that were run, for replaying them later against a copy
+// of the data (`days replay`). Capturing is opt-in: it is enabled by setting
+// DAYS_CAPTURE to the path of the log. Each line is one command:
+//
+//   date <TAB> elapsed microseconds <TAB> word <TAB> word ...
+//
+// The date is the day the command ran on, which is what `today` meant to it.
+// Tabs, newlines and backslashes in the words are escaped as \t, \n and \\.
+struct CapturedCommand {
+    std::chrono::sys_days today;
+    std::chrono::microseconds elapsed{0};
+    std::vector<std::string> words; // the arguments after the program name
+};
+
+// Appends `command` to the log at `path`. The line goes out in a single write
+// to a file opened for appending, so commands running at the same time don't
+// interleave their lines. Returns false if the log can't be written.
+bool appendCapturedCommand(const std::filesystem::path& path, const CapturedCommand& command);
+
+// Parses one line of a log, without its newline. Returns `std::nullopt` if it doesn't parse.
+std::optional<CapturedCommand> parseCapturedCommand(const std::string& line);
+
+// Reads the commands in the log at `path`, skipping lines that don't parse.
+// Returns `std::nullopt` if the log can't be read.
+std::optional<std::vector<CapturedCommand>> readCapturedCommands(const std::filesystem::path& path);
@@ -0,0 +1,159 @@
+#include "completion.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char indexMagic[8] = {'D', 'A', 'Y', 'S', 'C', 'I', 'X', '1'};
+
+// Sorts `strings`, drops duplicates and writes the offset table for them.
+void writeTable(std::ofstream& out, std::vector<std::string>& strings, std::uint64_t& position) {
+    std::sort(strings.begin(), strings.end());
+    strings.erase(std::unique(strings.begin(), strings.end()), strings.end());
+    for (const auto& s : strings) {
+        out.write(reinterpret_cast<const char*>(&position), sizeof position);
+        position += s.size();
+    }
+    out.write(reinterpret_cast<const char*>(&position), sizeof position);
+}
+
+}
+
+CompletionIndex::CompletionIndex(const std::filesystem::path& indexPath) {
+    int fd = open(indexPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) >= sizeof(Header)) {
+        void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            data = static_cast<const char*>(mapped);
+            size = info.st_size;
+        }
+    }
+    close(fd);
+    if (data == nullptr) {
+        return;
+    }
+
+    // Validate the header and the table sizes before trusting any offsets.
+    const auto* candidate = reinterpret_cast<const Header*>(data);
+    const std::uint64_t tableBytes = (candidate->categoryCount + candidate->descriptionCount + 2) * sizeof(std::uint64_t);
+    if (std::memcmp(candidate->magic, indexMagic, sizeof indexMagic) != 0 || tableBytes > size - sizeof(Header)) {
+        return;
+    }
+    header = candidate;
+    categoryOffsets = reinterpret_cast<const std::uint64_t*>(data + sizeof(Header));
+    descriptionOffsets = categoryOffsets + header->categoryCount + 1;
+    strings = data + sizeof(Header) + tableBytes;
+    const std::uint64_t stringBytes = size - sizeof(Header) - tableBytes;
+    if (categoryOffsets[header->categoryCount] > stringBytes || descriptionOffsets[header->descriptionCount] > stringBytes) {
+        header = nullptr;
+    }
+}
+
+CompletionIndex::~CompletionIndex() {
+    if (data != nullptr) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+
+bool CompletionIndex::isCurrent(const std::filesystem::path& eventsPath) const {
+    const auto stamp = FileStamp::of(eventsPath);
+    return header != nullptr && stamp.has_value() && header->eventsStamp == stamp.value();
+}
+
+std::vector<std::string> CompletionIndex::getCategories(const std::string& prefix, std::size_t limit) const {
+    if (header == nullptr) {
+        return {};
+    }
+    return getMatches(categoryOffsets, header->categoryCount, prefix, limit);
+}
+
+std::vector<std::string> CompletionIndex::getDescriptions(const std::string& prefix, std::size_t limit) const {
+    if (header == nullptr) {
+        return {};
+    }
+    return getMatches(descriptionOffsets, header->descriptionCount, prefix, limit);
+}
+
+std::vector<std::string> CompletionIndex::getMatches(const std::uint64_t* offsets, std::uint64_t count,
+                                                     const std::string& prefix, std::size_t limit) const {
+    auto at = [&](std::uint64_t i) {
+        return std::string_view(strings + offsets[i], offsets[i + 1] - offsets[i]);
+    };
+
+    // Binary search for the first entry not less than `prefix`; all the
+    // matches follow it contiguously.
+    std::uint64_t low = 0;
+    std::uint64_t high = count;
+    while (low < high) {
+        const std::uint64_t middle = low + (high - low) / 2;
+        if (at(middle) < prefix) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    std::vector<std::string> matches;
+    for (std::uint64_t i = low; i < count && matches.size() < limit; i++) {
+        const auto entry = at(i);
+        if (!entry.starts_with(prefix)) {
+            break;
+        }
+        matches.emplace_back(entry);
+    }
+    return matches;
+}
+
+bool CompletionIndex::write(const std::filesystem::path& indexPath, const std::filesystem::path& eventsPath,
+                            std::vector<std::string> categories, std::vector<std::string> descriptions) {
+    Header header{};
+    std::memcpy(header.magic, indexMagic, sizeof indexMagic);
+    const auto stamp = FileStamp::of(eventsPath);
+    if (!stamp.has_value()) {
+        return false;
+    }
+    header.eventsStamp = stamp.value();
+    for (auto& description : descriptions) {
+        if (description.size() > maxDescriptionLength) {
+            description.resize(maxDescriptionLength);
+        }
+    }
+
+    auto tempPath = indexPath;
+    tempPath += ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof header); // counts are patched below
+        std::uint64_t position = 0;
+        writeTable(out, categories, position);
+        writeTable(out, descriptions, position);
+        for (const auto& s : categories) {
+            out.write(s.data(), s.size());
+        }
+        for (const auto& s : descriptions) {
+            out.write(s.data(), s.size());
+        }
+
+        header.categoryCount = categories.size();
+        header.descriptionCount = descriptions.size();
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        if (!out) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, indexPath, error);
+    return !error;
+}
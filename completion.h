@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include "filestamp.h"
+
+// A persisted index of the distinct categories and descriptions in events.csv,
+// used for shell completion without parsing the CSV file.
+//
+// The file is memory-mapped and holds two sorted string tables, so a prefix
+// lookup is a binary search that only touches a handful of pages:
+//
+//   header | category offsets | description offsets | string data
+//
+// The header records the size and modification time of events.csv at the time
+// the index was written, which is how a stale index is detected.
+class CompletionIndex {
+public:
+    // Maps the index at `indexPath`. If the file is missing or malformed,
+    // the index is empty.
+    explicit CompletionIndex(const std::filesystem::path& indexPath);
+    ~CompletionIndex();
+
+    CompletionIndex(const CompletionIndex&) = delete;
+    CompletionIndex& operator=(const CompletionIndex&) = delete;
+
+    // Returns true if the index was written for the current contents of `eventsPath`.
+    bool isCurrent(const std::filesystem::path& eventsPath) const;
+
+    // Return at most `limit` entries starting with `prefix`, in sorted order.
+    std::vector<std::string> getCategories(const std::string& prefix, std::size_t limit) const;
+    std::vector<std::string> getDescriptions(const std::string& prefix, std::size_t limit) const;
+
+    // Writes an index of `categories` and `descriptions` (in any order, duplicates
+    // allowed) for the current contents of `eventsPath`. Descriptions are truncated
+    // to `maxDescriptionLength` bytes to keep the index small.
+    static bool write(const std::filesystem::path& indexPath, const std::filesystem::path& eventsPath,
+                      std::vector<std::string> categories, std::vector<std::string> descriptions);
+
+    static constexpr std::size_t maxDescriptionLength = 64;
+
+private:
+    struct Header {
+        char magic[8];
+        FileStamp eventsStamp;
+        std::uint64_t categoryCount;
+        std::uint64_t descriptionCount;
+    };
+
+    std::vector<std::string> getMatches(const std::uint64_t* offsets, std::uint64_t count,
+                                        const std::string& prefix, std::size_t limit) const;
+
+    const char* data = nullptr;
+    std::size_t size = 0;
+    const Header* header = nullptr;
+    const std::uint64_t* categoryOffsets = nullptr;
+    const std::uint64_t* descriptionOffsets = nullptr;
+    const char* strings = nullptr;
+};
@@ -0,0 +1,62 @@
+#include "config.h"
+
+#include <charconv>
+#include <fstream>
+
+namespace {
+
+std::string trim(const std::string& s) {
+    const auto first = s.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    const auto last = s.find_last_not_of(" \t\r");
+    return s.substr(first, last - first + 1);
+}
+
+}
+
+Config Config::load(const std::filesystem::path& path) {
+    Config config;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        const auto equals = line.find('=');
+        if (line.empty() || line.front() == '#' || equals == std::string::npos) {
+            continue;
+        }
+        config.settings[trim(line.substr(0, equals))] = trim(line.substr(equals + 1));
+    }
+    return config;
+}
+
+std::optional<std::string> Config::get(const std::string& key) const {
+    const auto setting = settings.find(key);
+    if (setting == settings.end()) {
+        return std::nullopt;
+    }
+    return setting->second;
+}
+
+std::optional<long long> Config::getNumber(const std::string& key) const {
+    const auto value = get(key);
+    if (!value.has_value()) {
+        return std::nullopt;
+    }
+    long long number = 0;
+    const auto* end = value->data() + value->size();
+    const auto [rest, error] = std::from_chars(value->data(), end, number);
+    if (error != std::errc{} || rest != end) {
+        return std::nullopt;
+    }
+    return number;
+}
+
+std::map<std::string, std::string> Config::getWithPrefix(const std::string& prefix) const {
+    std::map<std::string, std::string> matches;
+    for (auto setting = settings.lower_bound(prefix); setting != settings.end() && setting->first.starts_with(prefix); ++setting) {
+        matches.emplace(setting->first.substr(prefix.size()), setting->second);
+    }
+    return matches;
+}
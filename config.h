@@ -0,0 +1,26 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+
+// Settings read from ~/.days/config. The file has one `key = value` setting
+// per line; blank lines and lines starting with `#` are ignored.
+class Config {
+public:
+    // Reads the settings from `path`. A missing file means no settings.
+    static Config load(const std::filesystem::path& path);
+
+    std::optional<std::string> get(const std::string& key) const;
+
+    // Returns the setting `key` as an integer, or `std::nullopt` if it is
+    // missing or not a number.
+    std::optional<long long> getNumber(const std::string& key) const;
+
+    // Returns the settings whose keys start with `prefix`, keyed by the rest of the key.
+    std::map<std::string, std::string> getWithPrefix(const std::string& prefix) const;
+
+private:
+    std::map<std::string, std::string> settings;
+};
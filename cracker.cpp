@@ -0,0 +1,126 @@
+#include "cracker.h"
+
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+namespace {
+
+constexpr char crackerMagic[8] = {'D', 'A', 'Y', 'S', 'C', 'R', 'K', '1'};
+
+struct Header {
+    char magic[8];
+    FileStamp eventsStamp;
+    std::uint64_t rowCount;
+    std::uint64_t pivotCount;
+};
+
+struct Pivot {
+    std::int32_t value;
+    std::uint32_t position;
+};
+
+}
+
+DateCracker::DateCracker(std::vector<std::int32_t> d) : days(std::move(d)), rows(days.size()) {
+    std::iota(rows.begin(), rows.end(), 0);
+}
+
+std::vector<std::uint32_t> DateCracker::select(std::optional<std::int32_t> low, std::optional<std::int32_t> high) {
+    const std::uint32_t begin = low.has_value() ? crack(low.value()) : 0;
+    const std::uint32_t end = high.has_value() ? crack(high.value()) : static_cast<std::uint32_t>(days.size());
+    if (begin >= end) {
+        return {};
+    }
+    return std::vector<std::uint32_t>(rows.begin() + begin, rows.begin() + end);
+}
+
+std::uint32_t DateCracker::crack(std::int32_t pivot) {
+    auto next = pivots.lower_bound(pivot);
+    if (next != pivots.end() && next->first == pivot) {
+        return next->second; // already cracked here
+    }
+
+    // The piece to partition lies between the neighbouring pivots.
+    std::uint32_t first = next == pivots.begin() ? 0 : std::prev(next)->second;
+    std::uint32_t last = next == pivots.end() ? static_cast<std::uint32_t>(days.size()) : next->second;
+
+    // Crack-in-two: move the values below the pivot to the front of the piece,
+    // keeping the row positions aligned with their values.
+    while (first < last) {
+        if (days[first] < pivot) {
+            first++;
+        } else if (days[last - 1] >= pivot) {
+            last--;
+        } else {
+            std::swap(days[first], days[last - 1]);
+            std::swap(rows[first], rows[last - 1]);
+            first++;
+            last--;
+        }
+    }
+
+    pivots.emplace(pivot, first);
+    changed = true;
+    return first;
+}
+
+std::optional<DateCracker> DateCracker::load(const std::filesystem::path& path, const FileStamp& eventsStamp, std::size_t rowCount) {
+    std::ifstream in(path, std::ios::binary);
+    Header header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof header) ||
+        std::memcmp(header.magic, crackerMagic, sizeof crackerMagic) != 0 ||
+        !(header.eventsStamp == eventsStamp) || header.rowCount != rowCount) {
+        return std::nullopt;
+    }
+
+    DateCracker cracker;
+    std::vector<Pivot> pivots(header.pivotCount);
+    cracker.days.resize(rowCount);
+    cracker.rows.resize(rowCount);
+    in.read(reinterpret_cast<char*>(pivots.data()), pivots.size() * sizeof(Pivot));
+    in.read(reinterpret_cast<char*>(cracker.days.data()), rowCount * sizeof(std::int32_t));
+    in.read(reinterpret_cast<char*>(cracker.rows.data()), rowCount * sizeof(std::uint32_t));
+    if (!in) {
+        return std::nullopt;
+    }
+    for (auto row : cracker.rows) {
+        if (row >= rowCount) {
+            return std::nullopt;
+        }
+    }
+    for (const auto& pivot : pivots) {
+        if (pivot.position > rowCount) {
+            return std::nullopt;
+        }
+        cracker.pivots.emplace_hint(cracker.pivots.end(), pivot.value, pivot.position);
+    }
+    return cracker;
+}
+
+bool DateCracker::save(const std::filesystem::path& path, const FileStamp& eventsStamp) const {
+    Header header{};
+    std::memcpy(header.magic, crackerMagic, sizeof crackerMagic);
+    header.eventsStamp = eventsStamp;
+    header.rowCount = days.size();
+    header.pivotCount = pivots.size();
+
+    auto tempPath = path;
+    tempPath += ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        for (const auto& [value, position] : pivots) {
+            const Pivot pivot{value, position};
+            out.write(reinterpret_cast<const char*>(&pivot), sizeof pivot);
+        }
+        out.write(reinterpret_cast<const char*>(days.data()), days.size() * sizeof(std::int32_t));
+        out.write(reinterpret_cast<const char*>(rows.data()), rows.size() * sizeof(std::uint32_t));
+        if (!out) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    return !error;
+}
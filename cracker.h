@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include "filestamp.h"
+
+// An adaptive index ("database cracking") over the date column of the events.
+//
+// Instead of sorting the dates up front, the column is copied once and then
+// reorganized a little on every range query: the piece of the column that
+// contains a query bound is partitioned around it, and the bound is remembered
+// as a pivot. Repeated queries over similar ranges find their bounds already
+// in place, so they converge to the cost of a sorted index without ever paying
+// for a full sort.
+//
+// Dates are stored as days since the epoch, together with the position of the
+// event they came from.
+class DateCracker {
+public:
+    // Starts a fresh, uncracked column from `days` (one entry per event).
+    explicit DateCracker(std::vector<std::int32_t> days);
+
+    // Returns the positions of the events whose date is in [`low`, `high`).
+    // A missing bound means the range is open on that side. The positions
+    // come out in column order, not in event order.
+    std::vector<std::uint32_t> select(std::optional<std::int32_t> low, std::optional<std::int32_t> high);
+
+    // Returns true if a query has reorganized the column since it was loaded.
+    bool isChanged() const { return changed; }
+
+    std::size_t getPivotCount() const { return pivots.size(); }
+
+    // Loads the organization saved for `eventsStamp` with `rowCount` events. Returns
+    // `std::nullopt` if there is none or it was saved for a different events file.
+    static std::optional<DateCracker> load(const std::filesystem::path& path, const FileStamp& eventsStamp, std::size_t rowCount);
+
+    // Saves the current organization of the column, tagged with `eventsStamp`.
+    bool save(const std::filesystem::path& path, const FileStamp& eventsStamp) const;
+
+private:
+    DateCracker() = default;
+
+    // Partitions the piece containing `pivot` so that all values below it come
+    // first, and returns the position of the first value not below it.
+    std::uint32_t crack(std::int32_t pivot);
+
+    std::vector<std::int32_t> days;
+    std::vector<std::uint32_t> rows;
+    std::map<std::int32_t, std::uint32_t> pivots; // pivot value -> first position >= pivot
+    bool changed = false;
+};
@@ -0,0 +1,9 @@
+# Bash completion for days. Source this file from ~/.bashrc.
+# For zsh, run `autoload -U bashcompinit && bashcompinit` before sourcing it.
+_days()
+{
+    local IFS=$'\n'
+    local candidates=($(days complete "${COMP_WORDS[@]:1:COMP_CWORD}" 2>/dev/null))
+    COMPREPLY=($(printf '%q\n' "${candidates[@]}"))
+}
+complete -F _days days
@@ -9,77 +9,49 @@
 #include <string_view> // for std::string_view
 #include <filesystem>  // for path utilities
 #include <memory>      // for smart pointers
+#include <fstream>     // for file streams
+#include <cstdint>     // for fixed-width integer types
+#include <cerrno>      // for errno
+#include <map>         // for std::map
+#include <algorithm>   // for std::min_element, std::remove_if
+#include <cctype>      // for std::isspace
+#include <cstring>     // for std::memchr
+#include <mutex>       // for std::unique_lock
+#include <shared_mutex> // for sharing the daemon's events between workers
+#include <iterator>    // for std::back_inserter
+#include <charconv>    // for std::from_chars
+#include <functional>  // for std::function
+#include <thread>      // for std::thread
+#include <cmath>       // for std::llround
+#include <csignal>     // for ignoring SIGPIPE from reminder hooks
+#include <cstdio>      // for popen
+#include <poll.h>        // for poll
+#include <sys/inotify.h> // for watching the events directory
+#include <sys/stat.h>    // for stat
+#include <unistd.h>      // for read, close, fork
+#include <fcntl.h>       // for open
+#include <sys/wait.h>    // for waitpid
+#include <sys/mman.h>    // for mapping events.csv
 
-#include "event.h"    // for our Event class
-#include "rapidcsv.h" // for the header-only library RapidCSV
-
-// Parses the string `buf` for a date in YYYY-MM-DD format. If `buf` can be parsed,
-// returns a wrapped `std::chrono::year_month_day` instances, otherwise `std::nullopt`.
-// NOTE: Once clang++ and g++ implement chrono::from_stream, this could be replaced by
-// something like this:
-//  chrono::year_month_day birthdate;
-//  std::istringstream bds{birthdateValue};
-//  std::basic_istream<char> stream{bds.rdbuf()};
-//  chrono::from_stream(stream, "%F", birthdate);
-// However, I don't know how errors should be handled. Maybe this function could then
-// continue to serve as a wrapper.
-
-std::optional<std::chrono::year_month_day> getDateFromString(const std::string &buf)
-{
-    using namespace std; // use std facilities without prefix inside this function
-
-    constexpr string_view yyyymmdd = "YYYY-MM-DD";
-    if (buf.size() != yyyymmdd.size())
-    {
-        return nullopt;
-    }
-
-    istringstream input(buf);
-    string part;
-    vector<string> parts;
-    while (getline(input, part, '-'))
-    {
-        parts.push_back(part);
-    }
-    if (parts.size() != 3)
-    { // expecting three components, year-month-day
-        return nullopt;
-    }
-
-    int year{0};
-    unsigned int month{0};
-    unsigned int day{0};
-    try
-    {
-        year = stoul(parts.at(0));
-        month = stoi(parts.at(1));
-        day = stoi(parts.at(2));
-
-        auto result = chrono::year_month_day{
-            chrono::year{year},
-            chrono::month(month),
-            chrono::day(day)};
-
-        if (result.ok())
-        {
-            return result;
-        }
-        else
-        {
-            return nullopt;
-        }
-    }
-    catch (invalid_argument const &ex)
-    {
-        cerr << "conversion error: " << ex.what() << endl;
-    }
-    catch (out_of_range const &ex)
-    {
-        cerr << "conversion error: " << ex.what() << endl;
-    }
-
-    return nullopt;
-}
+#include "event.h"      // for our Event class
+#include "prefixstring.h" // for counting categories by their prefixes
+#include "completion.h" // for the shell completion index
+#include "cracker.h"    // for the adaptive date index
+#include "config.h"     // for the settings in ~/.days/config
+#include "filter.h"     // for --where expressions
+#include "kernels.h"    // for the specialized filter scans
+#include "server.h"     // for the daemon behind `days serve`
+#include "protocol.h"   // for the messages between `days remote` and the daemon
+#include "shards.h"     // for the sharded daemon
+#include "prepared.h"   // for the daemon's prepared queries
+#include "filestamp.h"  // for noticing changes to events.csv
+#include "capture.h"    // for capturing and replaying commands
+#include "reminders.h"  // for `days remind`
+#include "rewrite.h"    // for deleting rows by copying byte ranges
+#include "wal.h"        // for the daemon's write-ahead log
+#include "extsort.h"    // for sorting files bigger than memory
+#include "sketches.h"   // for stats --approx
+#include "rowindex.h"   // for finding rows of events.csv by number
 
 // Returns the value of the environment variable `name` as an `std::optional``
 // value. If the variable exists, the value is a wrapped `std::string`,
@@ -95,33 +67,18 @@ std::optional<std::string> getEnvironmentVariable(const std::string &name)
     return std::nullopt;
 }
 
-// Returns `date` as a string in `YYYY-MM-DD` format.
-// The ostream support for `std::chrono::year_month_day` is not
-// available in most (any?) compilers, so we roll our own.
-std::string getStringFromDate(const std::chrono::year_month_day &date)
-{
-    std::ostringstream result;
-
-    result
-        << std::setfill('0') << std::setw(4) << static_cast<int>(date.year())
-        << "-" << std::setfill('0') << std::setw(2) << static_cast<unsigned>(date.month())
-        << "-" << std::setfill('0') << std::setw(2) << static_cast<unsigned>(date.day());
-
-    return result.str();
-}
-
-// Print `T` to standard output.
+// Print `T` to standard output, or to `out`.
 // `T` needs to have an overloaded << operator.
 template <typename T>
-void display(const T &value)
+void display(const T &value, std::ostream &out = std::cout)
 {
-    std::cout << value;
+    out << value;
 }
 
-// Prints a newline to standard output.
-inline void newline()
+// Prints a newline to standard output, or to `out`.
+inline void newline(std::ostream &out = std::cout)
 {
-    std::cout << std::endl;
+    out << std::endl;
 }
 
 // Overload the << operator for the Event class.
@@ -129,9 +86,9 @@ inline void newline()
 std::ostream &operator<<(std::ostream &os, const Event &event)
 {
     os
-        << getStringFromDate(event.getTimestamp()) << ": "
+        << getStringFromDateTime(event) << ": "
         << event.getDescription()
-        << " (" + event.getCategory() + ")";
+        << " (" << event.getCategory() << ")";
     return os;
 }
 
@@ -165,8 +122,92 @@ std::string getHomeDirectory()
     return "";
 }
 
-void listEvents(std::vector<Event> events, std::chrono::sys_days today, int argc, std::string option1, std::string parameter1, std::string option2, std::string parameter2,
-                std::string option3, std::string parameter3)
+// Returns true if `a` happens before `b`: on an earlier day, or earlier on the
+// same day. An event without a time is at the start of its day.
+bool isEarlier(const Event &a, const Event &b)
+{
+    return getMinuteNumber(a) < getMinuteNumber(b);
+}
+
+// Reads the number of rows at the start of events.csv that are known to be sorted
+// by date (the "base"), as recorded in the layout sidecar at `layoutPath`. Rows after
+// the base (the "tail") are in the order they were added. Returns 0 if there is no
+// sidecar, which means the whole file is tail.
+std::size_t readBaseRows(const std::filesystem::path &layoutPath)
+{
+    std::ifstream file(layoutPath);
+    std::string key, equals;
+    std::size_t rows{0};
+    if (file >> key >> equals >> rows && key == "base_rows" && equals == "=")
+        return rows;
+    return 0;
+}
+
+// Records in the layout sidecar at `layoutPath` that the first `rows` rows of
+// events.csv are sorted by date.
+void writeBaseRows(const std::filesystem::path &layoutPath, std::size_t rows)
+{
+    std::ofstream file(layoutPath, std::ios::trunc);
+    file << "base_rows = " << rows << "\n";
+}
+
+// Brings `events`, read in file order, into date order by sorting only the tail after
+// the first `baseRows` events and merging it with the already sorted base. Returns
+// false, leaving `events` as they were, if there is no base or it turns out not to be
+// sorted after all (for example because the file was edited by hand).
+bool mergeTail(std::vector<Event> &events, std::size_t baseRows)
+{
+    if (baseRows == 0 || baseRows > events.size())
+        return false;
+    const auto base = events.begin() + static_cast<std::ptrdiff_t>(baseRows);
+    if (!std::is_sorted(events.begin(), base, isEarlier))
+        return false;
+    std::stable_sort(base, events.end(), isEarlier);
+    std::inplace_merge(events.begin(), base, events.end(), isEarlier);
+    return true;
+}
+
+// Reads all events from the CSV file at `eventsPath`. If `bytesRead` is given, it
+// receives the number of bytes that were parsed, so that rows appended later can be
+// picked up from that offset without reading the whole file again.
+std::vector<Event> loadEvents(const std::filesystem::path &eventsPath, std::uintmax_t *bytesRead = nullptr)
+{
+    using namespace std;
+
+    ifstream file(eventsPath, ios::binary);
+    ostringstream contents;
+    contents << file.rdbuf();
+    const string data = contents.str();
+    if (bytesRead != nullptr)
+        *bytesRead = data.size();
+
+    // Every line after the header is a row, parsed with `getEventFromRow` like
+    // everywhere else that reads the file.
+    vector<Event> events;
+    events.reserve(std::count(data.begin(), data.end(), '\n'));
+    const string_view text{data};
+    size_t position = text.find('\n');
+    for (size_t i{0}; position != string_view::npos && position + 1 < text.size(); i++)
+    {
+        const size_t end = min(text.find('\n', position + 1), text.size());
+        const string_view row = text.substr(position + 1, end - position - 1);
+        position = end;
+        if (auto event = getEventFromRow(row); event.has_value())
+        {
+            events.push_back(std::move(event.value()));
+            continue;
+        }
+        const auto fields = getFieldsFromRow(row);
+        if (fields.size() < 3)
+            cerr << "missing fields at row " << i << ": " << row << '\n';
+        else
+            cerr << "bad date at row " << i << ": " << fields[0] << '\n';
+    }
+    return events;
+}
+
+void listEvents(const std::vector<Event> &events, std::chrono::sys_days today, int argc, std::string option1, std::string parameter1, std::string option2, std::string parameter2,
+                std::string option3, std::string parameter3, std::ostream &out = std::cout)
 {
     for (auto &event : events)
     {
@@ -182,9 +223,11 @@ void listEvents(std::vector<Event> events, std::chrono::sys_days today, int argc
                 {
                     if (argc > 3 && argc != 5)
                     {
-                        if (argc == 6 && option2 == "--after-date" && getDateFromString(parameter1) <= event.getTimestamp() && getDateFromString(parameter2) > event.getTimestamp())
-                            continue;
-
+                        if (argc == 6 && option2 == "--after-date")
+                        {
+                            if (getDateFromString(parameter1) <= event.getTimestamp() || getDateFromString(parameter2) > event.getTimestamp())
+                                continue;
+                        }
                         else if (getDateFromString(parameter1) <= event.getTimestamp())
                         {
                             continue;
@@ -192,7 +235,7 @@ void listEvents(std::vector<Event> events, std::chrono::sys_days today, int argc
                     }
                     else
                     {
-                        std::cout << "Invalid parameters." << std::endl;
+                        out << "Invalid parameters." << std::endl;
                         break;
                     }
                 }
@@ -205,21 +248,14 @@ void listEvents(std::vector<Event> events, std::chrono::sys_days today, int argc
                     }
                     else
                     {
-                        std::cout << "Invalid parameters." << std::endl;
+                        out << "Invalid parameters." << std::endl;
                         break;
                     }
                 }
                 else if (option1 == "--description")
                 {
-                    int counter = 0;
-                    for (int i = 0; i < parameter1.length(); i++)
+                    if (!event.getDescription().starts_with(parameter1))
                     {
-                        if (parameter1[i] == event.getDescription()[i])
-                        {
-                            counter++;
-                        }
-                    }
-                    if(counter != parameter1.length()){
                         continue;
                     }
                 }
@@ -227,15 +263,7 @@ void listEvents(std::vector<Event> events, std::chrono::sys_days today, int argc
                 {
                     if (option2 == "--category" && option3 == "--description")
                     {
-                        int counter = 0;
-                        for (int i = 0; i < parameter3.length(); i++)
-                        {
-                            if (parameter3[i] == event.getDescription()[i])
-                            {
-                                counter++;
-                            }
-                        }
-                        if (event.getCategory() != parameter2 || counter != parameter3.length())
+                        if (event.getCategory() != parameter2 || !event.getDescription().starts_with(parameter3))
                         {
                             continue;
                         }
@@ -300,212 +328,2631 @@ void listEvents(std::vector<Event> events, std::chrono::sys_days today, int argc
             line << "today";
         }
 
-        display(line.str());
-        newline();
+        display(line.str(), out);
+        newline(out);
     }
 }
-void addEvents(std::filesystem::path eventsPath, std::chrono::sys_days today, int argc, std::string option1, std::string parameter1, std::string option2, std::string parameter2, std::string option3, std::string parameter3)
+// Lists the events in the date range of a `--before-date` and/or `--after-date` query
+// through the date cracker saved at `crackerPath`, which reorganizes the date column
+// around the bounds of each query instead of testing every event. Without `crackerPath`
+// (when the events aren't just those of events.csv), a fresh cracker is used and not
+// saved. Returns false if the options don't describe such a range, so that the caller
+// can use `listEvents` instead.
+// If `events` are `sorted` by date, the range is found by binary search instead.
+bool listEventsInRange(const std::vector<Event> &events, bool sorted, std::chrono::sys_days today, const std::optional<std::filesystem::path> &crackerPath, const std::filesystem::path &eventsPath,
+                       int argc, std::string option1, std::string parameter1, std::string option2, std::string parameter2)
 {
-    std::ofstream file(eventsPath, std::ios::app);
+    std::optional<std::string> beforeText;
+    std::optional<std::string> afterText;
+    if (option1 == "--before-date" && argc == 4)
+    {
+        beforeText = parameter1;
+    }
+    else if (option1 == "--before-date" && argc == 6 && option2 == "--after-date")
+    {
+        beforeText = parameter1;
+        afterText = parameter2;
+    }
+    else if (option1 == "--after-date" && argc == 4)
+    {
+        afterText = parameter1;
+    }
+    if (!beforeText.has_value() && !afterText.has_value())
+        return false;
+
+    std::optional<std::chrono::year_month_day> before;
+    std::optional<std::chrono::year_month_day> after;
+    // A bound that isn't a date is an error, not a range left open on that side.
+    for (const auto *text : {&beforeText, &afterText})
+    {
+        if (text->has_value() && !getDateFromString(text->value()).has_value())
+        {
+            std::cout << "Invalid date: " << text->value() << std::endl;
+            return true;
+        }
+    }
+    if (beforeText.has_value())
+        before = getDateFromString(beforeText.value());
+    if (afterText.has_value())
+        after = getDateFromString(afterText.value());
+
+    if (sorted)
+    {
+        auto first = events.begin();
+        auto last = events.end();
+        if (after.has_value())
+            first = std::lower_bound(first, last, Event{after.value(), "", ""}, isEarlier);
+        if (before.has_value())
+            last = std::lower_bound(first, last, Event{before.value(), "", ""}, isEarlier);
+        listEvents(std::vector<Event>(first, std::max(first, last)), today, 2, "", "", "", "", "", "");
+        return true;
+    }
+
+    const auto eventsStamp = FileStamp::of(eventsPath);
+    std::optional<DateCracker> cracker;
+    if (eventsStamp.has_value() && crackerPath.has_value())
+        cracker = DateCracker::load(crackerPath.value(), eventsStamp.value(), events.size());
+    if (!cracker.has_value())
+    {
+        std::vector<std::int32_t> days;
+        days.reserve(events.size());
+        for (const auto &event : events)
+            days.push_back(event.getDayNumber());
+        cracker.emplace(std::move(days));
+    }
+
+    std::optional<std::int32_t> low;
+    std::optional<std::int32_t> high;
+    if (after.has_value())
+        low = getDayNumberFromDate(after.value());
+    if (before.has_value())
+        high = getDayNumberFromDate(before.value());
+    auto rows = cracker->select(low, high);
+
+    // The cracked column is in no particular order, so restore the file order for listing.
+    std::sort(rows.begin(), rows.end());
+    std::vector<Event> selected;
+    selected.reserve(rows.size());
+    for (auto row : rows)
+        selected.push_back(events[row]);
+    listEvents(selected, today, 2, "", "", "", "", "", "");
+
+    if (cracker->isChanged() && eventsStamp.has_value() && crackerPath.has_value())
+        cracker->save(crackerPath.value(), eventsStamp.value());
+    return true;
+}
+
+// Appends an event to the events file according to the options. Returns the
+// appended event, or `std::nullopt` if the options were invalid.
+std::optional<Event> addEvents(std::filesystem::path eventsPath, std::chrono::sys_days today, int argc, std::string option1, std::string parameter1, std::string option2, std::string parameter2, std::string option3, std::string parameter3)
+{
+    std::optional<Event> event;
     if (option1 == "--category" && argc == 6 && option2 == "--description")
     {
-        file << getStringFromDate(today) << "," << parameter1 << "," << parameter2 << "\n";
+        event = Event{today, parameter1, parameter2};
     }
     else if (option1 == "--date" && option2 == "--category" && option3 == "--description")
     {
-        file << parameter1 << "," << parameter2 << "," << parameter3 << "\n";
+        const auto date = getDateTimeFromString(parameter1);
+        if (!date.has_value())
+        {
+            std::cout << "Invalid date: " << parameter1 << std::endl;
+            return std::nullopt;
+        }
+        event = Event{date->date, parameter2, parameter3, date->time};
     }
     else
+    {
         std::cout << "Invalid options" << std::endl;
+        return std::nullopt;
+    }
+
+    // The fields are quoted as needed, but a row can't span lines.
+    const auto row = getRowFromEvent(event.value());
+    if (row.find('\n') != std::string::npos)
+    {
+        std::cout << "The category and description can't have line breaks" << std::endl;
+        return std::nullopt;
+    }
+    std::ofstream file(eventsPath, std::ios::app);
+    file << row << "\n";
+    return event;
 }
 
-void deleteEvents(std::vector<Event> events, std::chrono::sys_days today, std::filesystem::path eventsPath, std::string homeDirectoryString,
-                  int argc, std::string option1, std::string parameter1, std::string option2, std::string parameter2, std::string option3, std::string parameter3, std::string final)
+// Returns true if `event` would be removed by `delete` with the given options. The
+// shell's `delete`, `days delete` and its dry run all decide with this, so the same
+// command line picks the same events in each.
+bool isDeletedBy(const Event &event, std::string option1, std::string parameter1, std::string option2, std::string parameter2,
+                 std::string option3, std::string parameter3)
 {
+    if (option1 == "--all")
+        return true;
+    if (option1 == "--description")
+        return event.getDescription().starts_with(parameter1);
+    if (option1 != "--date" || getDateFromString(parameter1) != event.getTimestamp())
+        return false;
+    if (option2 == "--category" && event.getCategory() != parameter2)
+        return false;
+    if (option3 == "--description" && !event.getDescription().starts_with(parameter3))
+        return false;
+    return true;
+}
 
-    std::fstream file(eventsPath);
-    std::string tempFilePath = homeDirectoryString + "/.days/tempFile.csv";
-    std::ofstream tempFile(tempFilePath);
-    std::string text;
-    int line = 0;
-    while (std::getline(file, text))
+// Deletes the rows of events.csv that match the given options. The kept rows are
+// copied to the new file as byte ranges of the old one, without going through
+// userspace, so deleting a few rows from a large file costs little more than
+// finding them. The events don't need to be loaded for this.
+bool deleteMatchingRows(std::filesystem::path eventsPath, std::filesystem::path layoutPath, std::string option1, std::string parameter1,
+                        std::string option2, std::string parameter2, std::string option3, std::string parameter3)
+{
+    if (option1 != "--all" && option1 != "--date" && option1 != "--description")
     {
-        line++;
-        if (option1 == "--date" && option2 == "--category" && option3 == "--description")
-        {
-            if (text.find(parameter1) != std::string::npos && text.find(parameter2) != std::string::npos)
-            {
-                int counter = 0;
-                int preDesc = parameter1.length() + parameter2.length() + 2; // The file format is "date,category,description", so using the lenghts and the 2 commas, we can compare descriptions.
-                for (int i = 0; i < parameter3.length(); i++)
-                {
-                    if (parameter3[i] == text[preDesc + i])
-                    {
-                        counter++;
-                    }
-                }
-                if (counter == parameter3.length())
-                    continue;
-            }
-        }
-        else if (option1 == "--date" && option2 == "--category")
-        {
-            if (text.find(parameter1) != std::string::npos && text.find(parameter2) != std::string::npos)
-            {
-                continue;
-            }
-        }
-        else if (option1 == "--date" && text.find(parameter1) != std::string::npos)
-        {
-            continue;
-        }
-        else if (option1 == "--description")
-        {
-            int descStart = 0;
-            int counter = 0;
-            for (int i = 0; i < text.length(); i++)
-            { // Different method for finding description start, finding second comma
-                if (text[i] = ',')
-                {
-                    counter++;
-                }
-                if (counter == 2)
-                {
-                    descStart = i + 1;
-                    counter = 0;
-                    break;
-                }
-            }
-            for (int i = descStart; i < text.length(); i++)
-            {
-                if (parameter1[i - descStart] == text[i])
-                {
-                    counter++;
-                }
-            }
-            if (counter == parameter1.length())
-            {
-                continue;
-            }
-        }
-        else if (option1 == "--all" && line != 1)
-        {
-            continue;
-        }
-        else if (option1 != "--all" && option1 != "--date" && option1 != "--description")
-        {
-            std::cout << "Invalid parameters" << std::endl;
-            return;
-        }
+        std::cout << "Invalid parameters" << std::endl;
+        return false;
+    }
 
-        tempFile << text << std::endl;
+    // Each row is matched as the event it parses to, exactly like the dry run does.
+    // Rows that don't parse are kept, since they were never events.
+    auto isDeleted = [&](std::string_view row)
+    {
+        const auto event = getEventFromRow(row);
+        return event.has_value() && isDeletedBy(event.value(), option1, parameter1, option2, parameter2, option3, parameter3);
+    };
+
+    // Deleting rows keeps the order of the others, so the sorted base only shrinks.
+    const std::size_t baseRows = readBaseRows(layoutPath);
+    std::string error;
+    const auto deletion = deleteRows(eventsPath, baseRows, isDeleted, error);
+    if (!deletion.has_value())
+    {
+        std::cerr << "Unable to delete the events: " << error << std::endl;
+        return false;
     }
-    file.close();
-    tempFile.close();
+    if (baseRows > 0 && deletion->deleted > 0)
+        writeBaseRows(layoutPath, deletion->keptBaseRows);
+    return true;
+}
+
+void deleteEvents(std::vector<Event> events, std::chrono::sys_days today, std::filesystem::path eventsPath, std::filesystem::path layoutPath,
+                  std::string option1, std::string parameter1, std::string option2, std::string parameter2, std::string option3, std::string parameter3, std::string final)
+{
     if (final != "--dry-run")
     {
-        std::remove(eventsPath.c_str());
-        std::rename(tempFilePath.c_str(), eventsPath.c_str());
+        deleteMatchingRows(eventsPath, layoutPath, option1, parameter1, option2, parameter2, option3, parameter3);
+        return;
     }
-    else
+    if (option1 != "--all" && option1 != "--date" && option1 != "--description")
     {
-        std::cout << "Dry run, would delete:" << std::endl;
-        listEvents(events, today, argc, option1, parameter1, option2, parameter2, option3, parameter3);
-        std::remove(tempFilePath.c_str());
+        std::cout << "Invalid parameters" << std::endl;
+        return;
     }
+    std::cout << "Dry run, would delete:" << std::endl;
+    std::vector<Event> deleted;
+    std::copy_if(events.begin(), events.end(), std::back_inserter(deleted), [&](const Event &event)
+                 { return isDeletedBy(event, option1, parameter1, option2, parameter2, option3, parameter3); });
+    listEvents(deleted, today, 2, "", "", "", "", "", "");
 }
 
-int main(int argc, char *argv[])
+// Returns the row number in `parameter`, or `std::nullopt` after saying why it is
+// not a row of events.csv according to `index`.
+std::optional<std::size_t> getRowNumber(const RowIndex &index, const std::string &parameter)
 {
-    using namespace std;
+    std::size_t row = 0;
+    const auto [end, code] = std::from_chars(parameter.data(), parameter.data() + parameter.size(), row);
+    if (code != std::errc{} || end != parameter.data() + parameter.size())
+    {
+        std::cout << "Invalid row number: " << parameter << std::endl;
+        return std::nullopt;
+    }
+    if (row >= index.size())
+    {
+        std::cout << "There is no row " << row << ", events.csv has " << index.size() << " rows" << std::endl;
+        return std::nullopt;
+    }
+    return row;
+}
 
-    // Get the current date from the system clock and extract year_month_day.
-    // See https://en.cppreference.com/w/cpp/chrono/year_month_day
-    const chrono::time_point now = chrono::system_clock::now();
-    const chrono::year_month_day currentDate{chrono::floor<chrono::days>(now)};
+// Prints the event on row `parameter` of events.csv (counted from 0 after the header,
+// like in the errors of `loadEvents`), reading only that row. The row index at
+// `rowsPath` says where it is; it is built first if events.csv has changed since.
+bool showRow(const std::filesystem::path &eventsPath, const std::filesystem::path &rowsPath, const std::string &parameter,
+             std::chrono::sys_days today)
+{
+    const auto index = RowIndex::open(rowsPath, eventsPath);
+    if (!index.has_value())
+    {
+        std::cerr << "Unable to read " << eventsPath.string() << std::endl;
+        return false;
+    }
+    const auto row = getRowNumber(index.value(), parameter);
+    if (!row.has_value())
+        return false;
 
-    // Note that you can't print an `std::chrono::year_month_day`
-    // with `display()` because there is no overloaded << operator
-    // for it (yet).
+    const std::uint64_t offset = index->getOffset(row.value());
+    std::string text(index->getEnd(row.value()) - offset, '\0');
+    const int fd = open(eventsPath.c_str(), O_RDONLY | O_CLOEXEC);
+    const bool read = fd >= 0 && pread(fd, text.data(), text.size(), static_cast<off_t>(offset)) == static_cast<ssize_t>(text.size());
+    if (fd >= 0)
+        close(fd);
+    if (!read)
+    {
+        std::cerr << "Unable to read " << eventsPath.string() << std::endl;
+        return false;
+    }
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+        text.pop_back();
 
-    // Construct a path for the events file.
-    // If the user's home directory can't be determined, give up.
-    std::string homeDirectoryString = getHomeDirectory();
-    if (homeDirectoryString == "")
-        return 1;
+    if (const auto event = getEventFromRow(text); event.has_value())
+        listEvents({event.value()}, today, 2, "", "", "", "", "", "");
+    else
+        std::cout << "Row " << row.value() << " is not a valid event: " << text << std::endl;
+    return true;
+}
 
-    // Using ternary operators variables can be assigned with argv[] values depending on the value of
-    // argc without repeating if statements. Default assignment is an empty string
-    std::string final = (argc > 0) ? std::string(argv[argc - 1]) : "";
-    std::string command = (argc > 1) ? std::string(argv[1]) : "";
-    std::string option1 = (argc > 2) ? std::string(argv[2]) : "";
-    std::string parameter1 = (argc > 3) ? std::string(argv[3]) : "";
-    std::string option2 = (argc > 4) ? std::string(argv[4]) : "";
-    std::string parameter2 = (argc > 5) ? std::string(argv[5]) : "";
-    std::string option3 = (argc > 6) ? std::string(argv[6]) : "";
-    std::string parameter3 = (argc > 7) ? std::string(argv[7]) : "";
+// Deletes row `parameter` of events.csv (numbered like in `showRow`) by copying the
+// bytes before and after it, found through the row index, so the rest of the file
+// isn't read at all. The index is then updated in memory rather than rebuilt.
+bool deleteRow(const std::filesystem::path &eventsPath, const std::filesystem::path &layoutPath, const std::filesystem::path &rowsPath,
+               const std::string &parameter)
+{
+    auto index = RowIndex::open(rowsPath, eventsPath);
+    if (!index.has_value())
+    {
+        std::cerr << "Unable to read " << eventsPath.string() << std::endl;
+        return false;
+    }
+    const auto row = getRowNumber(index.value(), parameter);
+    if (!row.has_value())
+        return false;
 
-    namespace fs = std::filesystem; // save a little typing
-    fs::path daysPath{homeDirectoryString};
-    daysPath /= ".days"; // append our own directory
-    if (!fs::exists(daysPath))
+    const std::uint64_t offset = index->getOffset(row.value());
+    const std::uint64_t end = index->getEnd(row.value());
+    std::string error;
+    if (!rewriteRanges(eventsPath, {{0, offset}, {end, index->getBytes() - end}}, "", error))
     {
-        display(daysPath.string());
-        display(" does not exist, please create it");
-        newline();
-        return 1; // nothing to do anymore, exit program
+        std::cerr << "Unable to delete the row: " << error << std::endl;
+        return false;
+    }
+    // Deleting a row keeps the order of the others, so the sorted base only shrinks.
+    if (const std::size_t baseRows = readBaseRows(layoutPath); row.value() < baseRows)
+        writeBaseRows(layoutPath, baseRows - 1);
+    index->erase(row.value());
+    index->save(rowsPath, eventsPath);
+    return true;
+}
 
-        // To create the directory:
-        // std::filesystem::create_directory(daysPath);
-        // See issue: https://github.com/jerekapyaho/days_cpp/issues/4
+// Prints summary statistics of `events`: how many there are in total, how they
+// fall relative to `today`, the date range they cover and the count per category.
+void statsEvents(const std::vector<Event> &events, std::chrono::sys_days today, std::ostream &out = std::cout)
+{
+    int past = 0;
+    int upcoming = 0;
+    int todays = 0;
+    std::map<PrefixString, int> categories;
+    for (const auto &event : events)
+    {
+        const auto delta = (std::chrono::sys_days{event.getTimestamp()} - today).count();
+        if (delta < 0)
+            past++;
+        else if (delta > 0)
+            upcoming++;
+        else
+            todays++;
+        categories[event.getCategory()]++;
     }
 
-    // Now we should have a valid path to the `~/.days` directory.
-    // Construct a pathname for the `events.csv` file.
-    auto eventsPath = daysPath / "events.csv";
+    out << "events: " << events.size() << " (" << past << " past, " << todays << " today, " << upcoming << " upcoming)" << std::endl;
+    if (events.empty())
+        return;
 
-    //
-    // Read in the CSV file from `eventsPath` using RapidCSV
-    // See https://github.com/d99kris/rapidcsv
-    //
-    rapidcsv::Document document{eventsPath.string()};
-    vector<string> dateStrings{document.GetColumn<string>("date")};
-    vector<string> categoryStrings{document.GetColumn<string>("category")};
-    vector<string> descriptionStrings{document.GetColumn<string>("description")};
+    out << "first: " << getStringFromDate(std::min_element(events.begin(), events.end(), isEarlier)->getTimestamp()) << std::endl;
+    out << "last: " << getStringFromDate(std::max_element(events.begin(), events.end(), isEarlier)->getTimestamp()) << std::endl;
+    for (const auto &[category, count] : categories)
+    {
+        out << "  " << (category.empty() ? "(no category)" : category.view()) << ": " << count << std::endl;
+    }
+}
 
-    vector<Event> events;
-    for (size_t i{0}; i < dateStrings.size(); i++)
+// Prints the approximate statistics of `sketch`: the number of distinct
+// descriptions and their most frequent words and two-word phrases.
+void printApproximateStats(const DescriptionSketch &sketch, std::ostream &out = std::cout)
+{
+    constexpr std::size_t topCount = 10;
+    out << "events: " << sketch.getCount() << std::endl;
+    out << "distinct descriptions: ~" << std::llround(sketch.getDistinct()) << std::endl;
+    for (const auto &[title, top] : {std::pair{"top words:", sketch.getTopWords(topCount)},
+                                     std::pair{"top phrases:", sketch.getTopPhrases(topCount)}})
     {
-        auto date = getDateFromString(dateStrings.at(i));
-        if (!date.has_value())
+        out << title << std::endl;
+        for (const auto &[term, count] : top)
+            out << "  " << term << ": ~" << count << std::endl;
+    }
+}
+
+// Returns the sketch of the descriptions of `events`.
+DescriptionSketch sketchEvents(const std::vector<Event> &events)
+{
+    DescriptionSketch sketch;
+    for (const auto &event : events)
+        sketch.add(event.getDescription());
+    return sketch;
+}
+
+// Prints the approximate statistics of events.csv at `eventsPath` without loading
+// the events: the file is mapped and split at row boundaries among threads, each
+// of which sketches the descriptions in its part in one pass, and the sketches
+// are merged.
+bool statsEventsApproximately(const std::filesystem::path &eventsPath)
+{
+    const int fd = open(eventsPath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info{};
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        std::cerr << "Unable to read " << eventsPath.string() << std::endl;
+        return false;
+    }
+    const auto size = static_cast<std::size_t>(info.st_size);
+    void *mapped = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        std::cerr << "Unable to read " << eventsPath.string() << std::endl;
+        return false;
+    }
+    const std::string_view data(static_cast<const char *>(mapped), size);
+
+    // Parts of at least a few megabytes, so that small files don't start threads for nothing.
+    constexpr std::size_t minimumPart = std::size_t{4} << 20;
+    const std::size_t threads = std::clamp<std::size_t>(size / minimumPart, 1, std::max(std::thread::hardware_concurrency(), 1u));
+    std::vector<std::size_t> starts{std::min(data.find('\n'), size)}; // after the header
+    for (std::size_t i = 1; i < threads; i++)
+        starts.push_back(std::max(std::min(data.find('\n', size * i / threads), size), starts.back()));
+    starts.push_back(size);
+
+    std::vector<DescriptionSketch> sketches(threads);
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < threads; i++)
+    {
+        workers.emplace_back([&, i]()
+                             {
+            // Each part runs from just after a newline to the newline that ends its last row.
+            std::size_t position = starts[i] + 1;
+            while (position < starts[i + 1] + 1 && position < size)
+            {
+                const std::size_t end = std::min(data.find('\n', position), size);
+                const std::string_view row = data.substr(position, end - position);
+                position = end + 1;
+                if (const auto event = getEventFromRow(row); event.has_value())
+                    sketches[i].add(event->getDescription().view());
+            } });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    for (std::size_t i = 1; i < threads; i++)
+        sketches.front().merge(sketches[i]);
+    if (mapped != nullptr)
+        munmap(mapped, size);
+
+    printApproximateStats(sketches.front());
+    return true;
+}
+
+// Returns the rows of the events file at `eventsPath` that don't parse as events,
+// each with its newline, in the order of the file.
+std::string getUnparsedRows(const std::filesystem::path &eventsPath)
+{
+    std::ifstream file(eventsPath, std::ios::binary);
+    std::string row;
+    std::string rows;
+    std::getline(file, row); // the header
+    while (std::getline(file, row))
+    {
+        if (!getEventFromRow(row).has_value())
         {
-            cerr << "bad date at row " << i << ": " << dateStrings.at(i) << '\n';
-            continue;
+            rows += row;
+            rows += '\n';
         }
+    }
+    return rows;
+}
 
-        Event event{
-            date.value(),
-            categoryStrings.at(i),
-            descriptionStrings.at(i)};
-        events.push_back(event);
+// Writes the header and `events` to a new file at `path` that is to replace the
+// events file at `replaced`. The rows of `replaced` that don't parse as events are
+// copied after the events as they are, since they were never loaded and would
+// otherwise be lost. An event with a line break in it can't be written as a row,
+// and is dropped with a message. With `sync`, returns only once the file is on disk.
+bool writeEventsFile(const std::filesystem::path &path, const std::vector<Event> &events, bool sync, const std::filesystem::path &replaced)
+{
+    {
+        const std::string unparsed = getUnparsedRows(replaced);
+        std::ofstream file(path, std::ios::trunc);
+        file << "date,category,description\n";
+        for (const auto &event : events)
+        {
+            const auto row = getRowFromEvent(event);
+            if (row.find('\n') != std::string::npos)
+            {
+                std::cerr << "Dropped an event with a line break: " << row << std::endl;
+                continue;
+            }
+            file << row << "\n";
+        }
+        file << unparsed;
+        if (!file.flush())
+            return false;
     }
+    if (!sync)
+        return true;
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    const bool synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0)
+        close(fd);
+    return synced;
+}
 
-    const auto today = chrono::sys_days{
-        floor<chrono::days>(chrono::system_clock::now())};
+// Writes `events` to `eventsPath`, replacing the previous events. The rows are
+// written to a temporary file first and renamed into place, so that a failed
+// write can't leave a truncated events file behind.
+bool saveEvents(const std::filesystem::path &eventsPath, const std::vector<Event> &events)
+{
+    auto tempFilePath = eventsPath;
+    tempFilePath += ".tmp";
+    if (!writeEventsFile(tempFilePath, events, false, eventsPath))
+        return false;
+    std::error_code error;
+    std::filesystem::rename(tempFilePath, eventsPath, error);
+    return !error;
+}
 
-    if (argc > 1)
+// Applies the adds and deletes of the daemon's log `records` (see wal.h) to
+// `events`, read from an events file with the stamp `stamp`. If the log has a
+// checkpoint that wrote that very file, only the records after it are applied.
+// Returns the number of records applied.
+std::size_t applyLogRecords(std::vector<Event> &events, const std::vector<LogRecord> &records, const std::optional<FileStamp> &stamp)
+{
+    auto first = records.begin();
+    for (auto record = records.begin(); record != records.end(); ++record)
+    {
+        if (record->type == LogRecordType::Checkpoint && stamp.has_value() && decodeCheckpoint(record->body) == stamp)
+            first = record + 1;
+    }
+    std::size_t applied = 0;
+    for (auto record = first; record != records.end(); ++record)
     {
-        if (command == "list")
+        if (record->type == LogRecordType::Add)
         {
-            listEvents(events, today, argc, option1, parameter1, option2, parameter2, option3, parameter3);
+            if (auto event = getEventFromRow(record->body); event.has_value())
+                events.push_back(std::move(event.value()));
         }
-        else if (command == "add" && (argc == 6 || argc == 8))
+        else if (record->type == LogRecordType::Delete)
         {
-            addEvents(eventsPath, today, argc, option1, parameter1, option2, parameter2, option3, parameter3);
+            std::string error;
+            if (const auto filter = Filter::deserialize(record->body, error); filter.has_value())
+                std::erase_if(events, [&](const Event &event)
+                              { return filter->matches(event); });
         }
-        else if (command == "delete" && argc > 2)
-        {
-            deleteEvents(events, today, eventsPath, homeDirectoryString, argc, option1, parameter1, option2, parameter2, option3, parameter3, final);
+        applied += record->type != LogRecordType::Checkpoint;
+    }
+    return applied;
+}
+
+// Writes `events` to events.csv and empties `log`, so that a crash at any point
+// leaves either the old file and the whole log or the new file: the new file is
+// synced, a checkpoint with its stamp is logged, and only then is the file renamed
+// into place and the log emptied. `baseRows` of the events are sorted.
+bool checkpointEvents(WriteAheadLog &log, const std::vector<Event> &events, const std::filesystem::path &eventsPath,
+                      const std::filesystem::path &layoutPath, std::size_t baseRows)
+{
+    auto tempFilePath = eventsPath;
+    tempFilePath += ".tmp";
+    if (!writeEventsFile(tempFilePath, events, true, eventsPath))
+        return false;
+    const auto stamp = FileStamp::of(tempFilePath);
+    if (!stamp.has_value() || !log.append(LogRecordType::Checkpoint, encodeCheckpoint(stamp.value())))
+        return false;
+    std::error_code error;
+    std::filesystem::rename(tempFilePath, eventsPath, error);
+    if (error)
+        return false;
+    if (const int directory = open(eventsPath.parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC); directory >= 0)
+    {
+        fsync(directory);
+        close(directory);
+    }
+    writeBaseRows(layoutPath, baseRows);
+    return log.reset();
+}
+
+// Folds into events.csv the changes that a daemon logged but didn't fold in
+// itself, because it didn't shut down cleanly. An incomplete record at the end
+// of the log, from a crash in the middle of writing it, is dropped.
+bool recoverLoggedEvents(WriteAheadLog &log, const std::filesystem::path &eventsPath, const std::filesystem::path &layoutPath)
+{
+    std::uint64_t discarded = 0;
+    const auto records = log.recover(discarded);
+    if (discarded > 0)
+        std::cerr << "Dropped an incomplete record of " << discarded << " bytes at the end of the log." << std::endl;
+    if (records.empty())
+        return true;
+
+    const auto stamp = FileStamp::of(eventsPath);
+    auto events = loadEvents(eventsPath);
+    const auto applied = applyLogRecords(events, records, stamp);
+    if (applied == 0)
+        return log.reset();
+    if (!checkpointEvents(log, events, eventsPath, layoutPath, std::is_sorted_until(events.begin(), events.end(), isEarlier) - events.begin()))
+        return false;
+    std::cerr << "Recovered " << applied << " logged changes." << std::endl;
+    return true;
+}
+
+// How long events are kept, from the `retain_days` settings of the config file:
+// `retain_days = N` applies to every category, `retain_days.<category> = N`
+// overrides it for one category.
+struct RetentionPolicy
+{
+    std::optional<int> days;
+    std::map<std::string, int, std::less<>> categoryDays;
+
+    bool isEmpty() const { return !days.has_value() && categoryDays.empty(); }
+};
+
+// Reads the retention policy from the `retain_days` settings of `config`. Prints
+// the offending setting and returns `std::nullopt` if one is not a number of days
+// from 0 to `maxRetainDays`, since guessing could expire events that should stay.
+std::optional<RetentionPolicy> getRetentionPolicy(const Config &config)
+{
+    constexpr long long maxRetainDays = 1000000; // over 2700 years
+    auto getDays = [&config](const std::string &key) -> std::optional<int>
+    {
+        const auto days = config.getNumber(key);
+        if (!days.has_value() || days.value() < 0 || days.value() > maxRetainDays)
+        {
+            std::cerr << "Invalid setting in the config: " << key << " = " << config.get(key).value_or("")
+                      << " (expected a number of days from 0 to " << maxRetainDays << ")" << std::endl;
+            return std::nullopt;
+        }
+        return static_cast<int>(days.value());
+    };
+
+    RetentionPolicy policy;
+    if (config.get("retain_days").has_value())
+    {
+        policy.days = getDays("retain_days");
+        if (!policy.days.has_value())
+            return std::nullopt;
+    }
+    for (const auto &[category, value] : config.getWithPrefix("retain_days."))
+    {
+        const auto days = getDays("retain_days." + category);
+        if (!days.has_value())
+            return std::nullopt;
+        policy.categoryDays[category] = days.value();
+    }
+    return policy;
+}
+
+// Returns true if `event` is older than `policy` allows to keep it on `today`.
+bool isExpired(const Event &event, const RetentionPolicy &policy, std::chrono::sys_days today)
+{
+    const auto category = policy.categoryDays.find(event.getCategory().view());
+    const std::optional<int> days = category != policy.categoryDays.end() ? category->second : policy.days;
+    return days.has_value() && std::chrono::sys_days{event.getTimestamp()} < today - std::chrono::days{days.value()};
+}
+
+// Folds the tail of events.csv into the sorted base: drops the events that are
+// expired according to `policy`, rewrites the file in date order and records all
+// of its rows as the base. `sorted` tells if `events` are already in date order,
+// as they are when the tail has been merged on load.
+void compactEvents(std::vector<Event> events, bool sorted, std::filesystem::path eventsPath, std::filesystem::path layoutPath,
+                   const RetentionPolicy &policy, std::chrono::sys_days today)
+{
+    const auto expired = std::erase_if(events, [&](const Event &event)
+                                       { return isExpired(event, policy, today); });
+    if (!sorted)
+        std::stable_sort(events.begin(), events.end(), isEarlier);
+    if (!saveEvents(eventsPath, events))
+    {
+        std::cerr << "Unable to write " << eventsPath.string() << std::endl;
+        return;
+    }
+    writeBaseRows(layoutPath, events.size());
+    std::cout << "Compacted " << events.size() << " events";
+    if (expired > 0)
+        std::cout << ", dropped " << expired << " expired";
+    std::cout << "." << std::endl;
+}
+
+// Runs `sort`, `dedupe`, `diff <file>` or `compact` (with `policy` on `today`) on
+// events.csv through the external merge sort, with the runs spilled to ~/.days/tmp.
+// `--memory-limit <size>` bounds the memory used for the rows, 256M by default.
+// Sorting, deduplicating and compacting rewrite the file in date order, so all of
+// its rows become the sorted base.
+bool sortEventsExternally(const std::vector<std::string> &args, const std::filesystem::path &daysPath, const RetentionPolicy &policy,
+                          std::chrono::sys_days today)
+{
+    SortOptions options;
+    options.tempDirectory = daysPath / "tmp";
+    std::vector<std::string> operands;
+    for (std::size_t i = 2; i < args.size(); i++)
+    {
+        if (args[i] != "--memory-limit")
+        {
+            operands.push_back(args[i]);
+            continue;
+        }
+        const auto size = i + 1 < args.size() ? parseMemorySize(args[++i]) : std::nullopt;
+        if (!size.has_value() || size.value() < (std::size_t{1} << 20))
+        {
+            std::cerr << "Invalid --memory-limit, expected a size of at least 1M, like 512M" << std::endl;
+            return false;
+        }
+        options.memoryLimit = size.value();
+    }
+
+    const std::string &command = args[1];
+    const auto eventsPath = daysPath / "events.csv";
+    std::string error;
+    if (command == "diff")
+    {
+        if (operands.size() != 1)
+        {
+            std::cout << "Invalid command." << std::endl;
+            return false;
+        }
+        auto print = [](char side, std::string_view row)
+        { std::cout << side << row << '\n'; };
+        if (!diffRows(eventsPath, operands.front(), options, print, error))
+        {
+            std::cerr << "Unable to compare the events: " << error << std::endl;
+            return false;
+        }
+        std::cout << std::flush;
+        return true;
+    }
+    if (!operands.empty())
+    {
+        std::cout << "Invalid command." << std::endl;
+        return false;
+    }
+
+    if (command == "dedupe")
+    {
+        options.order = RowOrder::ByRow;
+        options.unique = true;
+    }
+    else if (command == "compact")
+    {
+        options.keep = [&](std::string_view row)
+        {
+            // Rows that aren't events are kept, and dropped by the sort only if
+            // their date doesn't parse.
+            const auto event = getEventFromRow(row);
+            return !event.has_value() || !isExpired(event.value(), policy, today);
+        };
+    }
+    const auto result = sortRows(eventsPath, eventsPath, options, error);
+    if (!result.has_value())
+    {
+        std::cerr << "Unable to sort the events: " << error << std::endl;
+        return false;
+    }
+    writeBaseRows(daysPath / "events.meta", result->rows);
+
+    if (result->invalid > 0)
+        std::cerr << "Dropped " << result->invalid << " rows with a bad date" << std::endl;
+    if (command == "sort")
+        std::cout << "Sorted " << result->rows << " events";
+    else if (command == "dedupe")
+        std::cout << "Kept " << result->rows << " events, dropped " << result->duplicates << " duplicates";
+    else
+    {
+        std::cout << "Compacted " << result->rows << " events";
+        if (result->filtered > 0)
+            std::cout << ", dropped " << result->filtered << " expired";
+    }
+    if (result->runs > 0)
+        std::cout << " (" << result->runs << " runs spilled)";
+    std::cout << "." << std::endl;
+    return true;
+}
+
+// Drops the first `rows` rows of events.csv by copying the header and the rest of
+// the file after them as two byte ranges, without formatting any rows. The rows
+// are meant to be the first `rows` events, so it returns false without changing
+// the file if one of them doesn't parse as an event (and so was never counted),
+// as well as if the file can't be rewritten.
+bool dropLeadingRows(const std::filesystem::path &eventsPath, std::size_t rows)
+{
+    std::ifstream file(eventsPath, std::ios::binary);
+    std::string header;
+    std::getline(file, header);
+    const std::uint64_t headerEnd = static_cast<std::uint64_t>(file.tellg());
+
+    std::string row;
+    for (std::size_t i = 0; i < rows; i++)
+    {
+        if (!std::getline(file, row) || !getEventFromRow(row).has_value())
+            return false;
+    }
+    const std::streamoff offset = file.peek() == std::char_traits<char>::eof() ? -1 : static_cast<std::streamoff>(file.tellg());
+    file.close();
+
+    std::error_code sizeError;
+    const auto size = std::filesystem::file_size(eventsPath, sizeError);
+    if (sizeError)
+        return false;
+    const auto start = offset < 0 ? size : static_cast<std::uint64_t>(offset);
+    std::string error;
+    return rewriteRanges(eventsPath, {{0, headerEnd}, {start, size - start}}, "", error);
+}
+
+// Applies the retention `policy`. When the whole file is the sorted base, the expired
+// events form a prefix of it and are dropped as one block; otherwise (or if some
+// category expires sooner than the events around it, or rows that aren't events
+// are mixed in with the expired ones) the file is compacted, which
+// drops the expired events row by row and folds in the tail.
+void pruneEvents(std::vector<Event> events, bool sorted, std::filesystem::path eventsPath, std::filesystem::path layoutPath,
+                 const RetentionPolicy &policy, std::chrono::sys_days today)
+{
+    if (policy.isEmpty())
+    {
+        std::cout << "No retention configured." << std::endl;
+        return;
+    }
+
+    const std::size_t baseRows = readBaseRows(layoutPath);
+    if (sorted && baseRows == events.size())
+    {
+        std::size_t leading = 0;
+        while (leading < events.size() && isExpired(events[leading], policy, today))
+            leading++;
+        const bool onlyLeading = std::none_of(events.begin() + leading, events.end(), [&](const Event &event)
+                                              { return isExpired(event, policy, today); });
+        // If a row that isn't an event is among the leading ones, the rows are
+        // told apart by compacting instead.
+        if (onlyLeading && (leading == 0 || dropLeadingRows(eventsPath, leading)))
+        {
+            if (leading > 0)
+                writeBaseRows(layoutPath, baseRows - leading);
+            std::cout << "Dropped " << leading << " expired events." << std::endl;
+            return;
+        }
+    }
+    compactEvents(std::move(events), sorted, eventsPath, layoutPath, policy, today);
+}
+
+// Compiles the filter given with `--where <expression>` or `--match <regex>`. Prints
+// the error and returns `std::nullopt` if it is not valid.
+std::optional<Filter> getFilterFromOption(const std::string &option, const std::string &parameter, std::ostream &out = std::cout)
+{
+    std::string error;
+    auto filter = option == "--match" ? Filter::compileMatch(parameter, error) : Filter::compile(parameter, error);
+    if (!filter.has_value())
+        out << "Invalid " << option << " filter: " << error << std::endl;
+    return filter;
+}
+
+// Removes `--timeout <seconds>` from the command line `args` and sets `timeout` to it,
+// if one was given. Only a `--timeout` in the place of an option counts, so that it
+// can still be the value of another option (such as a description). Prints the error
+// and returns false if the value is not a number of seconds in (0, 1 year].
+bool takeTimeoutOption(std::vector<std::string> &args, std::optional<std::chrono::milliseconds> &timeout,
+                       std::ostream &out = std::cerr)
+{
+    // Every option but these flags is followed by its value.
+    static const std::vector<std::string> flags{"--all", "--today", "--no-category", "--dry-run", "--explain", "--approx"};
+    constexpr double maxSeconds = 365 * 24 * 60 * 60;
+
+    timeout.reset();
+    for (std::size_t i = 2; i < args.size(); i++)
+    {
+        if (args[i] != "--timeout")
+        {
+            if (args[i].starts_with("--") && std::find(flags.begin(), flags.end(), args[i]) == flags.end())
+                i++; // skip the value
+            continue;
+        }
+        const std::string value = i + 1 < args.size() ? args[i + 1] : "";
+        double seconds = 0;
+        const auto [end, code] = std::from_chars(value.data(), value.data() + value.size(), seconds);
+        if (value.empty() || code != std::errc{} || end != value.data() + value.size() || !std::isfinite(seconds) ||
+            seconds <= 0 || seconds > maxSeconds)
+        {
+            out << "Invalid timeout: " << value << " (expected a positive number of seconds, at most a year)" << std::endl;
+            return false;
+        }
+        timeout = std::chrono::milliseconds{std::max<long long>(std::llround(seconds * 1000), 1)};
+        args.erase(args.begin() + static_cast<std::ptrdiff_t>(i), args.begin() + static_cast<std::ptrdiff_t>(std::min(i + 2, args.size())));
+        return true;
+    }
+    return true;
+}
+
+// Prints why a query stopped before it was finished.
+void reportStopped(const QueryControl &control, std::ostream &out = std::cerr)
+{
+    out << (control.isTimedOut() ? "Query timed out." : "Query cancelled.") << std::endl;
+}
+
+// Returns the events that match `filter`, in their current order, or `std::nullopt`
+// if `control` stopped the query. Common filter shapes are scanned by a specialized
+// kernel instead of the bytecode interpreter.
+std::optional<std::vector<Event>> selectEvents(const std::vector<Event> &events, const Filter &filter, const QueryControl &control)
+{
+    const auto rows = scan(EventColumns::of(events), filter, control);
+    if (!rows.has_value())
+        return std::nullopt;
+    std::vector<Event> selected;
+    selected.reserve(rows->size());
+    for (auto row : rows.value())
+        selected.push_back(events[row]);
+    return selected;
+}
+
+// Lists the events that match `filter`.
+void listEventsWhere(const std::vector<Event> &events, const Filter &filter, std::chrono::sys_days today, const QueryControl &control,
+                     std::ostream &out = std::cout)
+{
+    const auto selected = selectEvents(events, filter, control);
+    if (!selected.has_value())
+    {
+        reportStopped(control, out);
+        return;
+    }
+    listEvents(selected.value(), today, 2, "", "", "", "", "", "", out);
+}
+
+// Reads the query file of `multi-query` at `path`: a `--where` expression on each
+// line, with empty lines and lines starting with `#` skipped. Compiles them into
+// `filters` and keeps their text in `expressions`. Prints the first error and
+// returns false if the file can't be read or a query is not valid.
+bool readQueryFile(const std::filesystem::path &path, std::vector<std::string> &expressions, std::vector<Filter> &filters,
+                   std::ostream &out = std::cerr)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        out << "Unable to read " << path.string() << std::endl;
+        return false;
+    }
+    std::size_t lineNumber = 0;
+    for (std::string line; std::getline(file, line);)
+    {
+        lineNumber++;
+        const auto start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#')
+            continue;
+        const auto end = line.find_last_not_of(" \t\r");
+        std::string expression = line.substr(start, end - start + 1);
+        std::string error;
+        auto filter = Filter::compile(expression, error);
+        if (!filter.has_value())
+        {
+            out << "Invalid query on line " << lineNumber << " of " << path.string() << ": " << error << std::endl;
+            return false;
+        }
+        expressions.push_back(std::move(expression));
+        filters.push_back(std::move(filter.value()));
+    }
+    return true;
+}
+
+// Lists the events of each query of a `multi-query`: the events at the positions
+// `rowSets[i]` of `events` match `expressions[i]`. They are listed one query after
+// the other under a heading, or, with an `outputDirectory`, into a file of their
+// own there, query-1.txt for the first query and so on. Returns false if a file
+// can't be written.
+bool listRowSets(const std::vector<std::string> &expressions, const std::vector<Event> &events,
+                 const std::vector<std::vector<std::uint32_t>> &rowSets, std::chrono::sys_days today,
+                 const std::optional<std::filesystem::path> &outputDirectory)
+{
+    for (std::size_t i = 0; i < rowSets.size() && i < expressions.size(); i++)
+    {
+        std::vector<Event> selected;
+        selected.reserve(rowSets[i].size());
+        for (auto position : rowSets[i])
+            selected.push_back(events[position]);
+
+        if (!outputDirectory.has_value())
+        {
+            if (i > 0)
+                newline();
+            std::cout << "Query " << i + 1 << ": " << expressions[i] << " (" << selected.size() << " events)" << std::endl;
+            listEvents(selected, today, 2, "", "", "", "", "", "");
+            continue;
+        }
+        const auto path = outputDirectory.value() / ("query-" + std::to_string(i + 1) + ".txt");
+        std::ofstream file(path, std::ios::trunc);
+        listEvents(selected, today, 2, "", "", "", "", "", "", file);
+        if (!file)
+        {
+            std::cerr << "Unable to write " << path.string() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the plans of `filters`, and in `pointers` the pointers to them that
+// `scanShared` takes.
+std::vector<QueryPlan> getQueryPlans(std::vector<Filter> filters, std::vector<const QueryPlan *> &pointers)
+{
+    std::vector<QueryPlan> plans;
+    plans.reserve(filters.size());
+    for (auto &filter : filters)
+        plans.emplace_back(std::move(filter));
+    for (const auto &plan : plans)
+        pointers.push_back(&plan);
+    return plans;
+}
+
+// Runs `multi-query <file> [--output <directory>]`: runs every query in the file
+// (see `readQueryFile`) in one shared scan of the events, instead of a scan for
+// each, and lists the events of each query (see `listRowSets`).
+bool multiQueryEvents(const std::vector<Event> &events, const std::filesystem::path &queryPath,
+                      const std::optional<std::filesystem::path> &outputDirectory, std::chrono::sys_days today, const QueryControl &control)
+{
+    std::vector<std::string> expressions;
+    std::vector<Filter> filters;
+    if (!readQueryFile(queryPath, expressions, filters))
+        return false;
+    std::vector<const QueryPlan *> pointers;
+    const auto plans = getQueryPlans(std::move(filters), pointers);
+    const auto rowSets = scanShared(EventColumns::of(events), pointers, control);
+    if (!rowSets.has_value())
+    {
+        reportStopped(control);
+        return false;
+    }
+    return listRowSets(expressions, events, rowSets.value(), today, outputDirectory);
+}
+
+// Deletes the events that match `filter` by rewriting the events file with the
+// rest of them, copied as byte ranges like in `deleteEvents`. With `dryRun`, only lists the events that would be deleted.
+// Nothing is deleted if `control` stops the query.
+void deleteEventsWhere(std::vector<Event> events, const Filter &filter, std::chrono::sys_days today, std::filesystem::path eventsPath,
+                       std::filesystem::path layoutPath, bool dryRun, const QueryControl &control)
+{
+    if (dryRun)
+    {
+        std::cout << "Dry run, would delete:" << std::endl;
+        listEventsWhere(events, filter, today, control);
+        return;
+    }
+    const auto rows = scan(EventColumns::of(events), filter, control);
+    if (!rows.has_value())
+    {
+        reportStopped(control);
+        return;
+    }
+    if (rows->empty())
+        return;
+
+    // Whether a row matches depends only on its contents, so the rows of the file
+    // are matched again as the events they parse to, and the kept ones copied as
+    // byte ranges. Rows that don't parse are kept, since they were never events.
+    const std::size_t baseRows = readBaseRows(layoutPath);
+    std::string error;
+    const auto deletion = deleteRows(eventsPath, baseRows, [&](std::string_view row)
+                                     {
+        const auto event = getEventFromRow(row);
+        return event.has_value() && filter.matches(event.value()); },
+                                     error);
+    if (!deletion.has_value())
+    {
+        std::cerr << "Unable to delete the events: " << error << std::endl;
+        return;
+    }
+    if (baseRows > 0)
+        writeBaseRows(layoutPath, deletion->keptBaseRows);
+}
+
+// Keeps the result of a `list` query on screen and re-renders it whenever events.csv
+// changes or the date rolls over. `offset` is the number of bytes of the file already
+// parsed into `events`: rows appended after it are parsed incrementally, while any other
+// change (like the rewrite done by `delete`) reloads the whole file.
+void watchEvents(std::vector<Event> events, std::uintmax_t offset, std::filesystem::path eventsPath, int argc, std::string option1, std::string parameter1,
+                 std::string option2, std::string parameter2, std::string option3, std::string parameter3)
+{
+    using namespace std::chrono;
+
+    // Watch the directory rather than the file, since `delete` replaces the file.
+    int notifyFd = inotify_init1(IN_CLOEXEC);
+    if (notifyFd < 0 || inotify_add_watch(notifyFd, eventsPath.parent_path().c_str(),
+                                          IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0)
+    {
+        std::cerr << "Unable to watch " << eventsPath.parent_path().string() << std::endl;
+        if (notifyFd >= 0)
+            close(notifyFd);
+        return;
+    }
+
+    struct stat fileInfo{};
+    stat(eventsPath.c_str(), &fileInfo);
+    ino_t inode = fileInfo.st_ino;
+
+    auto render = [&]()
+    {
+        const auto today = getToday();
+        std::cout << "\033[H\033[2J"; // move the cursor home and clear the screen
+        listEvents(events, today, argc, option1, parameter1, option2, parameter2, option3, parameter3);
+        std::cout << std::flush;
+    };
+
+    render();
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        // Wake up at the next midnight even if nothing changes, so that the
+        // "in N days" column stays correct.
+        const auto now = system_clock::now();
+        const auto midnight = floor<days>(now) + days{1};
+        const auto timeout = duration_cast<milliseconds>(midnight - now).count() + 50;
+
+        pollfd pollInfo{notifyFd, POLLIN, 0};
+        const int ready = poll(&pollInfo, 1, static_cast<int>(timeout));
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (ready == 0)
+        {
+            render();
+            continue;
+        }
+
+        // Drain the pending notifications and see if any of them were about our file.
+        bool changed = false;
+        const ssize_t length = read(notifyFd, buffer, sizeof buffer);
+        for (ssize_t i = 0; i < length;)
+        {
+            const auto *notification = reinterpret_cast<const inotify_event *>(buffer + i);
+            if (notification->len > 0 && eventsPath.filename() == notification->name)
+                changed = true;
+            i += sizeof(inotify_event) + notification->len;
+        }
+        if (!changed)
+            continue;
+
+        if (stat(eventsPath.c_str(), &fileInfo) != 0)
+            continue; // the file is being replaced, wait for it to appear again
+
+        const auto size = static_cast<std::uintmax_t>(fileInfo.st_size);
+        if (fileInfo.st_ino != inode || size < offset)
+        {
+            inode = fileInfo.st_ino;
+            events = loadEvents(eventsPath, &offset);
+        }
+        else if (size > offset)
+        {
+            // Parse only the complete rows that were appended since the last time.
+            std::ifstream file(eventsPath, std::ios::binary);
+            file.seekg(static_cast<std::streamoff>(offset));
+            std::string text;
+            while (std::getline(file, text) && !file.eof())
+            {
+                offset += text.size() + 1;
+                if (auto event = getEventFromRow(text); event.has_value())
+                    events.push_back(std::move(event.value()));
+            }
+        }
+        else
+        {
+            continue;
+        }
+        render();
+    }
+    close(notifyFd);
+}
+
+// Returns the minute number of the current time, on the day of `getToday()`.
+std::int64_t getCurrentMinute()
+{
+    using namespace std::chrono;
+    const auto now = system_clock::now();
+    const auto minute = duration_cast<minutes>(now - floor<days>(now));
+    return getMinuteNumber(year_month_day{getToday()}, minute);
+}
+
+// Hands a batch of reminders to `hook`, run with the shell, as lines of the rule
+// and the events.csv row separated by a tab on its standard input. Without a hook
+// they are printed.
+void fireReminders(const std::vector<ReminderSchedule::Reminder> &due, const std::vector<Event> &events,
+                   const std::vector<ReminderRule> &rules, const std::optional<std::string> &hook)
+{
+    if (!hook.has_value())
+    {
+        for (const auto &reminder : due)
+            std::cout << events[reminder.event] << " [" << rules[reminder.rule].text << "]" << std::endl;
+        return;
+    }
+
+    std::string lines;
+    for (const auto &reminder : due)
+    {
+        const Event &event = events[reminder.event];
+        lines += rules[reminder.rule].text + '\t' + getRowFromEvent(event) + '\n';
+    }
+    FILE *pipe = popen(hook->c_str(), "w");
+    if (pipe == nullptr)
+    {
+        std::cerr << "Unable to run the reminder hook: " << std::strerror(errno) << std::endl;
+        return;
+    }
+    fwrite(lines.data(), 1, lines.size(), pipe);
+    if (const int status = pclose(pipe); status != 0)
+        std::cerr << "The reminder hook failed for " << due.size() << " reminders" << std::endl;
+}
+
+// Fires the reminders of the rules in ~/.days/reminders for the events until
+// interrupted. The rules and events are scheduled again whenever either file
+// changes; every reminder that is due in the same minute goes to the hook at once.
+void runReminders(const std::filesystem::path &daysPath, const std::optional<std::string> &hook)
+{
+    const auto eventsPath = daysPath / "events.csv";
+    const auto rulesPath = daysPath / "reminders";
+
+    int notifyFd = inotify_init1(IN_CLOEXEC);
+    if (notifyFd < 0 || inotify_add_watch(notifyFd, daysPath.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0)
+    {
+        std::cerr << "Unable to watch " << daysPath.string() << std::endl;
+        if (notifyFd >= 0)
+            close(notifyFd);
+        return;
+    }
+    // A hook that exits without reading all of its reminders mustn't stop us.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Reminders due in the current minute still fire when we start.
+    ReminderSchedule schedule(getCurrentMinute() - 1);
+    std::vector<Event> events;
+    std::vector<ReminderRule> rules;
+    auto reload = [&]()
+    {
+        std::vector<std::string> errors;
+        rules = readReminderRules(rulesPath, errors);
+        for (const auto &error : errors)
+            std::cerr << "Ignoring reminder rule " << error << std::endl;
+        events = loadEvents(eventsPath);
+        schedule.reset(events, rules);
+        std::cout << "Scheduled " << schedule.size() << " reminders from " << rules.size() << " rules" << std::endl;
+    };
+
+    reload();
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        if (const auto due = schedule.advance(getCurrentMinute()); !due.empty())
+            fireReminders(due, events, rules, hook);
+
+        // Wake up at the start of the next minute, or when a file changes.
+        using namespace std::chrono;
+        const auto now = system_clock::now();
+        const auto next = floor<minutes>(now) + minutes{1};
+        const auto timeout = duration_cast<milliseconds>(next - now).count() + 50;
+
+        pollfd pollInfo{notifyFd, POLLIN, 0};
+        const int ready = poll(&pollInfo, 1, static_cast<int>(timeout));
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (ready == 0)
+            continue;
+
+        bool changed = false;
+        const ssize_t length = read(notifyFd, buffer, sizeof buffer);
+        for (ssize_t i = 0; i < length;)
+        {
+            const auto *notification = reinterpret_cast<const inotify_event *>(buffer + i);
+            if (notification->len > 0 && (eventsPath.filename() == notification->name || rulesPath.filename() == notification->name))
+                changed = true;
+            i += sizeof(inotify_event) + notification->len;
+        }
+        if (changed)
+            reload();
+    }
+    close(notifyFd);
+}
+
+// Manages the reminder rules in ~/.days/reminders: `remind [list]` shows them,
+// `remind add <rule>` adds one, `remind remove <n>` removes the n-th one and
+// `remind run` fires them, through the command in the `remind_hook` setting.
+bool remindEvents(const std::vector<std::string> &args, const std::filesystem::path &daysPath, const Config &config)
+{
+    const auto rulesPath = daysPath / "reminders";
+    const std::string subcommand = args.size() > 2 ? args[2] : "list";
+
+    if (subcommand == "list" && args.size() <= 3)
+    {
+        std::vector<std::string> errors;
+        const auto rules = readReminderRules(rulesPath, errors);
+        for (std::size_t i = 0; i < rules.size(); i++)
+            std::cout << i + 1 << ". " << rules[i].text << std::endl;
+        for (const auto &error : errors)
+            std::cerr << "Invalid reminder rule " << error << std::endl;
+        return true;
+    }
+    if (subcommand == "add" && args.size() > 3)
+    {
+        std::string text;
+        for (std::size_t i = 3; i < args.size(); i++)
+            text += (i > 3 ? " " : "") + args[i];
+        std::string error;
+        const auto rule = parseReminderRule(text, error);
+        if (!rule.has_value())
+        {
+            std::cerr << "Invalid reminder rule: " << error << std::endl;
+            return false;
+        }
+        std::ofstream file(rulesPath, std::ios::app);
+        file << rule->text << "\n";
+        if (!file.flush())
+        {
+            std::cerr << "Unable to write " << rulesPath.string() << std::endl;
+            return false;
+        }
+        std::cout << "Reminder rule added." << std::endl;
+        return true;
+    }
+    if (subcommand == "remove" && args.size() == 4)
+    {
+        // Count the rules like `readReminderRules` does, keeping the comments.
+        std::size_t index = 0;
+        const auto [end, code] = std::from_chars(args[3].data(), args[3].data() + args[3].size(), index);
+        std::ifstream file(rulesPath);
+        std::string kept;
+        std::size_t count = 0;
+        bool removed = false;
+        for (std::string line; std::getline(file, line);)
+        {
+            const auto first = line.find_first_not_of(" \t\r");
+            if (first != std::string::npos && line[first] != '#' && ++count == index && code == std::errc{} && end == args[3].data() + args[3].size())
+            {
+                removed = true;
+                continue;
+            }
+            kept += line + "\n";
+        }
+        if (!removed)
+        {
+            std::cerr << "No reminder rule " << args[3] << std::endl;
+            return false;
+        }
+        auto tempPath = rulesPath;
+        tempPath += ".tmp";
+        bool written = false;
+        {
+            std::ofstream temp(tempPath);
+            written = static_cast<bool>(temp << kept << std::flush);
+        }
+        std::error_code renameError;
+        if (written)
+            std::filesystem::rename(tempPath, rulesPath, renameError);
+        if (!written || renameError)
+        {
+            std::cerr << "Unable to write " << rulesPath.string() << std::endl;
+            return false;
+        }
+        std::cout << "Reminder rule removed." << std::endl;
+        return true;
+    }
+    if (subcommand == "run" && args.size() == 3)
+    {
+        runReminders(daysPath, config.get("remind_hook"));
+        return true;
+    }
+    std::cout << "Invalid command." << std::endl;
+    return false;
+}
+
+// Splits a line typed at the shell prompt into words. Words are separated by
+// whitespace; single or double quotes group words, like in a regular shell.
+std::vector<std::string> splitCommandLine(const std::string &line)
+{
+    std::vector<std::string> words;
+    std::string word;
+    bool inWord = false;
+    char quote = '\0';
+    for (char c : line)
+    {
+        if (quote != '\0')
+        {
+            if (c == quote)
+                quote = '\0';
+            else
+                word += c;
+        }
+        else if (c == '"' || c == '\'')
+        {
+            quote = c;
+            inWord = true;
+        }
+        else if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            if (inWord)
+                words.push_back(word);
+            word.clear();
+            inWord = false;
+        }
+        else
+        {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (inWord)
+        words.push_back(word);
+    return words;
+}
+
+// Runs an interactive prompt that executes list/add/delete/stats commands against
+// `events`, which stay in memory for the whole session. Writes are persisted in
+// batches: added events are appended to the file every `appendBatchSize` adds, and
+// deletions rewrite the file once on `save` or when the shell exits.
+void shellEvents(std::vector<Event> events, std::filesystem::path eventsPath, std::filesystem::path layoutPath)
+{
+    constexpr std::size_t appendBatchSize = 64;
+
+    std::vector<Event> pending; // added, not yet appended to the file
+    bool rewrite = false;       // deleted, the whole file needs to be rewritten
+
+    auto flush = [&]()
+    {
+        if (rewrite)
+        {
+            if (!saveEvents(eventsPath, events))
+            {
+                std::cerr << "Unable to write " << eventsPath.string() << std::endl;
+                return;
+            }
+            writeBaseRows(layoutPath, std::is_sorted_until(events.begin(), events.end(), isEarlier) - events.begin());
+        }
+        else if (!pending.empty())
+        {
+            std::ofstream file(eventsPath, std::ios::app);
+            for (const auto &event : pending)
+            {
+                file << getRowFromEvent(event) << "\n";
+            }
+        }
+        pending.clear();
+        rewrite = false;
+    };
+
+    std::string line;
+    while (true)
+    {
+        std::cout << "days> " << std::flush;
+        if (!std::getline(std::cin, line))
+        {
+            newline();
+            break;
+        }
+
+        // Lay the words out like the command line arguments of the program, so that
+        // the options end up in the same positions as they do for `main`.
+        std::vector<std::string> args{"days"};
+        for (auto &word : splitCommandLine(line))
+            args.push_back(word);
+        std::optional<std::chrono::milliseconds> timeout;
+        if (!takeTimeoutOption(args, timeout, std::cout))
+            continue;
+        const int argc = static_cast<int>(args.size());
+        if (argc == 1)
+            continue;
+        auto arg = [&](int i)
+        { return i < argc ? args.at(i) : std::string{}; };
+        const std::string command = arg(1);
+        const std::string option1 = arg(2), parameter1 = arg(3);
+        const std::string option2 = arg(4), parameter2 = arg(5);
+        const std::string option3 = arg(6), parameter3 = arg(7);
+
+        const auto today = getToday();
+
+        if (command == "quit" || command == "exit")
+        {
+            break;
+        }
+        else if (command == "list" && (option1 == "--where" || option1 == "--match") && argc > 3)
+        {
+            if (auto filter = getFilterFromOption(option1, parameter1); filter.has_value())
+            {
+                const QueryControl control = timeout.has_value() ? QueryControl(timeout.value()) : QueryControl();
+                listEventsWhere(events, filter.value(), today, control);
+            }
+        }
+        else if (command == "list")
+        {
+            listEvents(events, today, argc, option1, parameter1, option2, parameter2, option3, parameter3);
+        }
+        else if (command == "stats")
+        {
+            statsEvents(events, today);
+        }
+        else if (command == "save")
+        {
+            flush();
+        }
+        else if (command == "add" && option1 == "--category" && argc == 6 && option2 == "--description")
+        {
+            events.emplace_back(std::chrono::year_month_day{today}, parameter1, parameter2);
+            pending.push_back(events.back());
+        }
+        else if (command == "add" && argc == 8 && option1 == "--date" && option2 == "--category" && option3 == "--description")
+        {
+            auto date = getDateTimeFromString(parameter1);
+            if (!date.has_value())
+            {
+                std::cout << "Invalid date: " << parameter1 << std::endl;
+                continue;
+            }
+            events.emplace_back(date->date, parameter2, parameter3, date->time);
+            pending.push_back(events.back());
+        }
+        else if (command == "delete" && (option1 == "--all" || option1 == "--date" || option1 == "--description" || ((option1 == "--where" || option1 == "--match") && argc > 3)))
+        {
+            std::optional<Filter> filter;
+            if ((option1 == "--where" || option1 == "--match") && !(filter = getFilterFromOption(option1, parameter1)).has_value())
+                continue;
+            auto deleted = [&](const Event &event)
+            { return filter.has_value() ? filter->matches(event) : isDeletedBy(event, option1, parameter1, option2, parameter2, option3, parameter3); };
+            if (args.back() == "--dry-run")
+            {
+                std::cout << "Dry run, would delete:" << std::endl;
+                std::vector<Event> selected;
+                std::copy_if(events.begin(), events.end(), std::back_inserter(selected), deleted);
+                listEvents(selected, today, 2, "", "", "", "", "", "");
+                continue;
+            }
+            const auto before = events.size();
+            events.erase(std::remove_if(events.begin(), events.end(), deleted), events.end());
+            std::erase_if(pending, deleted);
+            if (events.size() != before)
+                rewrite = true;
+            std::cout << "Deleted " << before - events.size() << " events." << std::endl;
+        }
+        else
+        {
+            std::cout << "Invalid command." << std::endl;
+        }
+
+        if (pending.size() >= appendBatchSize)
+            flush();
+    }
+    flush();
+}
+
+// The events held by the daemon. Queries share the lock; add, delete and reloads
+// take it exclusively. Adds and deletes are logged to `log` before they are
+// applied, rather than written to events.csv; adds share `logMutex` so that they
+// can share fsyncs, while deletes, reloads and checkpoints take it exclusively,
+// so that the log has the changes in the order they were applied.
+struct ServedEvents
+{
+    std::shared_mutex mutex;
+    std::vector<Event> events;
+    std::optional<FileStamp> stamp; // of the events file that `events` match, before the log
+    WriteAheadLog *log = nullptr;
+    std::shared_mutex logMutex;
+};
+
+// Reads the served events again from events.csv, which has the stamp `stamp`, and
+// applies the logged changes on top of it, since they aren't in the file. Both
+// locks of `served` must be held.
+void reloadServedEvents(ServedEvents &served, const std::filesystem::path &eventsPath, const std::filesystem::path &layoutPath,
+                        const std::optional<FileStamp> &stamp)
+{
+    served.events = loadEvents(eventsPath);
+    mergeTail(served.events, readBaseRows(layoutPath));
+    std::uint64_t discarded = 0;
+    applyLogRecords(served.events, served.log->recover(discarded), stamp);
+    served.stamp = stamp;
+}
+
+// The size of the log at which the daemon folds it into events.csv.
+constexpr std::uint64_t logCheckpointBytes = std::uint64_t{64} << 20;
+
+// Folds the log of `served` into events.csv if it has grown past `logCheckpointBytes`,
+// or with `force` if it has anything in it.
+void checkpointServedEvents(ServedEvents &served, const std::filesystem::path &eventsPath, const std::filesystem::path &layoutPath, bool force)
+{
+    const std::uint64_t limit = force ? 1 : logCheckpointBytes;
+    if (served.log->getSize() < limit)
+        return;
+    std::unique_lock logLock(served.logMutex);
+    if (served.log->getSize() < limit)
+        return; // another worker got here first
+    std::unique_lock lock(served.mutex);
+    // Writing over rows that someone else changed since the events were read would
+    // lose them, so those are read first.
+    if (const auto stamp = FileStamp::of(eventsPath); stamp != served.stamp)
+        reloadServedEvents(served, eventsPath, layoutPath, stamp);
+    const auto baseRows = std::is_sorted_until(served.events.begin(), served.events.end(), isEarlier) - served.events.begin();
+    if (!checkpointEvents(*served.log, served.events, eventsPath, layoutPath, baseRows))
+    {
+        std::cerr << "Unable to fold the log into " << eventsPath.string() << std::endl;
+        return;
+    }
+    served.stamp = FileStamp::of(eventsPath);
+}
+
+// Reloads the served events if the events file was changed by someone else, like an
+// edit by hand while the daemon is up.
+void refreshServedEvents(ServedEvents &served, const std::filesystem::path &eventsPath, const std::filesystem::path &layoutPath)
+{
+    {
+        std::shared_lock lock(served.mutex);
+        if (FileStamp::of(eventsPath) == served.stamp)
+            return;
+    }
+    std::unique_lock logLock(served.logMutex);
+    std::unique_lock lock(served.mutex);
+    const auto stamp = FileStamp::of(eventsPath);
+    if (stamp == served.stamp)
+        return; // another worker got here first
+    reloadServedEvents(served, eventsPath, layoutPath, stamp);
+}
+
+// Returns true if the command line `args` is an `add` the daemon can serve:
+// `add --category <c> --description <d>` or `add --date <d> --category <c> --description <d>`.
+bool isServedAdd(const std::vector<std::string> &args)
+{
+    return args.size() > 1 && args[1] == "add" &&
+           ((args.size() == 6 && args[2] == "--category" && args[4] == "--description") ||
+            (args.size() == 8 && args[2] == "--date" && args[4] == "--category" && args[6] == "--description"));
+}
+
+// Returns the event added by the `add` command line `args`, or prints why the date
+// is not valid and returns `std::nullopt`.
+std::optional<Event> getServedAdd(const std::vector<std::string> &args, std::chrono::sys_days today, std::ostream &out)
+{
+    if (args.size() == 6)
+        return Event{std::chrono::year_month_day{today}, args[3], args[5]};
+    const auto date = getDateTimeFromString(args[3]);
+    if (!date.has_value())
+    {
+        out << "Invalid date: " << args[3] << std::endl;
+        return std::nullopt;
+    }
+    return Event{date->date, args[5], args[7], date->time};
+}
+
+// Runs the command line `words` (without the program name) against the served
+// events and returns what the command printed.
+std::string runServedCommand(ServedEvents &served, const std::filesystem::path &eventsPath, const std::filesystem::path &layoutPath,
+                             const std::vector<std::string> &words, std::optional<std::chrono::milliseconds> timeout)
+{
+    std::vector<std::string> args{"days"};
+    args.insert(args.end(), words.begin(), words.end());
+    const int argc = static_cast<int>(args.size());
+    auto arg = [&](int i)
+    { return i < argc ? args.at(i) : std::string{}; };
+    const std::string command = arg(1);
+    const std::string option1 = arg(2), parameter1 = arg(3);
+    const std::string option2 = arg(4), parameter2 = arg(5);
+    const std::string option3 = arg(6), parameter3 = arg(7);
+
+    const auto today = getToday();
+    const QueryControl control = timeout.has_value() ? QueryControl(timeout.value()) : QueryControl();
+
+    std::ostringstream out;
+    if (command == "list" && (option1 == "--where" || option1 == "--match") && argc > 3)
+    {
+        if (auto filter = getFilterFromOption(option1, parameter1, out); filter.has_value())
+        {
+            std::shared_lock lock(served.mutex);
+            listEventsWhere(served.events, filter.value(), today, control, out);
+        }
+    }
+    else if (command == "list")
+    {
+        std::shared_lock lock(served.mutex);
+        listEvents(served.events, today, argc, option1, parameter1, option2, parameter2, option3, parameter3, out);
+    }
+    else if (command == "stats" && option1 == "--approx")
+    {
+        std::shared_lock lock(served.mutex);
+        printApproximateStats(sketchEvents(served.events), out);
+    }
+    else if (command == "stats")
+    {
+        std::shared_lock lock(served.mutex);
+        statsEvents(served.events, today, out);
+    }
+    else if (isServedAdd(args))
+    {
+        const auto event = getServedAdd(args, today, out);
+        if (!event.has_value())
+            return out.str();
+
+        {
+            std::shared_lock logLock(served.logMutex);
+            if (!served.log->append(LogRecordType::Add, getRowFromEvent(event.value())))
+            {
+                out << "Unable to log the event." << std::endl;
+                return out.str();
+            }
+            std::unique_lock lock(served.mutex);
+            served.events.push_back(event.value());
+        }
+        checkpointServedEvents(served, eventsPath, layoutPath, false);
+    }
+    else if (command == "delete" && (option1 == "--where" || option1 == "--match") && argc > 3)
+    {
+        auto filter = getFilterFromOption(option1, parameter1, out);
+        if (!filter.has_value())
+            return out.str();
+        if (args.back() == "--dry-run")
+        {
+            out << "Dry run, would delete:" << std::endl;
+            std::shared_lock lock(served.mutex);
+            listEventsWhere(served.events, filter.value(), today, control, out);
+            return out.str();
+        }
+
+        {
+            std::unique_lock logLock(served.logMutex);
+            std::unique_lock lock(served.mutex);
+            auto selected = selectEvents(served.events, filter.value(), control);
+            if (!selected.has_value())
+            {
+                reportStopped(control, out);
+                return out.str();
+            }
+            if (selected->empty())
+                return out.str();
+            std::string program;
+            filter->serialize(program);
+            if (!served.log->append(LogRecordType::Delete, program))
+            {
+                out << "Unable to log the delete." << std::endl;
+                return out.str();
+            }
+            std::vector<Event> kept;
+            kept.reserve(served.events.size() - selected->size());
+            std::copy_if(served.events.begin(), served.events.end(), std::back_inserter(kept),
+                         [&](const Event &event)
+                         { return !filter->matches(event); });
+            out << "Deleted " << served.events.size() - kept.size() << " events." << std::endl;
+            served.events = std::move(kept);
+        }
+        checkpointServedEvents(served, eventsPath, layoutPath, false);
+    }
+    else
+    {
+        out << "Invalid command." << std::endl;
+    }
+    return out.str();
+}
+
+// Executes a daemon request against `served`: runs the `plans` in one scan if it
+// is a multi-query, the plan if it is a query, and otherwise the command of `request`.
+std::string handleRequest(ServedEvents &served, const std::filesystem::path &eventsPath, const std::filesystem::path &layoutPath,
+                          const protocol::Request &request, const std::vector<const QueryPlan *> &plans)
+{
+    refreshServedEvents(served, eventsPath, layoutPath);
+    if (request.op == protocol::Op::Command)
+        return protocol::encodeText(request.id, protocol::Status::Text,
+                                    runServedCommand(served, eventsPath, layoutPath, request.words, request.timeout));
+
+    const QueryControl control = request.timeout.has_value() ? QueryControl(request.timeout.value()) : QueryControl();
+    std::shared_lock lock(served.mutex);
+    if (request.op == protocol::Op::MultiQuery)
+    {
+        const auto rowSets = scanShared(EventColumns::of(served.events), plans, control);
+        if (!rowSets.has_value())
+        {
+            std::ostringstream out;
+            reportStopped(control, out);
+            return protocol::encodeText(request.id, protocol::Status::Error, out.str());
+        }
+        return protocol::encodeRowSets(request.id, served.events, rowSets.value());
+    }
+    const auto rows = scan(EventColumns::of(served.events), *plans.front(), control);
+    if (!rows.has_value())
+    {
+        std::ostringstream out;
+        reportStopped(control, out);
+        return protocol::encodeText(request.id, protocol::Status::Error, out.str());
+    }
+    return protocol::encodeRows(request.id, served.events, rows.value());
+}
+
+// The events held by a daemon started with `--shards`. The shards own the events;
+// the file mutex only keeps workers from reloading or folding the log into
+// events.csv at the same time. The log is shared like in `ServedEvents`.
+struct ShardedServedEvents
+{
+    explicit ShardedServedEvents(std::size_t shardCount) : shards(shardCount) {}
+
+    ShardedEvents shards;
+    std::mutex fileMutex;
+    std::optional<FileStamp> stamp; // of the events file that the shards match, before the log
+    WriteAheadLog *log = nullptr;
+    std::shared_mutex logMutex;
+};
+
+// Reads the shards again from events.csv, which has the stamp `stamp`, and applies
+// the logged changes on top of it. The log lock and the file mutex of `served`
+// must be held.
+void reloadShardedEvents(ShardedServedEvents &served, const std::filesystem::path &eventsPath, const std::optional<FileStamp> &stamp)
+{
+    auto events = loadEvents(eventsPath);
+    std::uint64_t discarded = 0;
+    applyLogRecords(events, served.log->recover(discarded), stamp);
+    served.shards.load(std::move(events));
+    served.stamp = stamp;
+}
+
+// Reloads the shards if the events file was changed by someone else, and applies
+// the logged changes on top of it again.
+void refreshShardedEvents(ShardedServedEvents &served, const std::filesystem::path &eventsPath)
+{
+    {
+        std::lock_guard lock(served.fileMutex);
+        if (FileStamp::of(eventsPath) == served.stamp)
+            return;
+    }
+    std::unique_lock logLock(served.logMutex);
+    std::lock_guard lock(served.fileMutex);
+    const auto stamp = FileStamp::of(eventsPath);
+    if (stamp == served.stamp)
+        return; // another worker got here first
+    reloadShardedEvents(served, eventsPath, stamp);
+}
+
+// Folds the log of `served` into events.csv like `checkpointServedEvents`.
+void checkpointShardedEvents(ShardedServedEvents &served, const std::filesystem::path &eventsPath, const std::filesystem::path &layoutPath, bool force)
+{
+    const std::uint64_t limit = force ? 1 : logCheckpointBytes;
+    if (served.log->getSize() < limit)
+        return;
+    std::unique_lock logLock(served.logMutex);
+    std::lock_guard lock(served.fileMutex);
+    if (served.log->getSize() < limit)
+        return;
+    if (const auto stamp = FileStamp::of(eventsPath); stamp != served.stamp)
+        reloadShardedEvents(served, eventsPath, stamp);
+    // The shards hand the events back in date order, so the whole file is base.
+    const auto events = served.shards.getEvents();
+    if (!checkpointEvents(*served.log, events, eventsPath, layoutPath, events.size()))
+    {
+        std::cerr << "Unable to fold the log into " << eventsPath.string() << std::endl;
+        return;
+    }
+    served.stamp = FileStamp::of(eventsPath);
+}
+
+// Executes a daemon request against the shards. Queries, multi-queries, adds and
+// deletes go to the shards that own the events; any other command runs on a copy gathered from
+// all of them.
+std::string handleShardedRequest(ShardedServedEvents &served, const std::filesystem::path &eventsPath, const std::filesystem::path &layoutPath,
+                                 const protocol::Request &request, const std::vector<const QueryPlan *> &plans)
+{
+    refreshShardedEvents(served, eventsPath);
+    const QueryControl control = request.timeout.has_value() ? QueryControl(request.timeout.value()) : QueryControl();
+    std::ostringstream out;
+    if (request.op == protocol::Op::MultiQuery)
+    {
+        const auto selection = served.shards.selectShared(plans, control);
+        if (!selection.has_value())
+        {
+            reportStopped(control, out);
+            return protocol::encodeText(request.id, protocol::Status::Error, out.str());
+        }
+        return protocol::encodeRowSets(request.id, selection->events, selection->rowSets);
+    }
+    if (request.op != protocol::Op::Command)
+    {
+        const auto selected = served.shards.select(*plans.front(), control);
+        if (!selected.has_value())
+        {
+            reportStopped(control, out);
+            return protocol::encodeText(request.id, protocol::Status::Error, out.str());
+        }
+        return protocol::encodeRows(request.id, selected.value());
+    }
+
+    std::vector<std::string> args{"days"};
+    args.insert(args.end(), request.words.begin(), request.words.end());
+    if (args.size() < 2)
+        return protocol::encodeText(request.id, protocol::Status::Text, "Invalid command.\n");
+    const bool isFiltered = args.size() > 3 && (args[2] == "--where" || args[2] == "--match");
+    const auto today = getToday();
+
+    if (isServedAdd(args))
+    {
+        if (const auto event = getServedAdd(args, today, out); event.has_value())
+        {
+            std::shared_lock logLock(served.logMutex);
+            if (served.log->append(LogRecordType::Add, getRowFromEvent(event.value())))
+                served.shards.add(event.value());
+            else
+                out << "Unable to log the event." << std::endl;
+        }
+        checkpointShardedEvents(served, eventsPath, layoutPath, false);
+    }
+    else if (args[1] == "list" && isFiltered)
+    {
+        if (auto filter = getFilterFromOption(args[2], args[3], out); filter.has_value())
+        {
+            if (const auto selected = served.shards.select(QueryPlan(std::move(filter.value())), control); selected.has_value())
+                listEvents(selected.value(), today, 2, "", "", "", "", "", "", out);
+            else
+                reportStopped(control, out);
+        }
+    }
+    else if (args[1] == "stats" && args.size() > 2 && args[2] == "--approx")
+    {
+        // Every shard sketches its own events; the sketches merge into those of all events.
+        std::vector<DescriptionSketch> sketches(served.shards.getShardCount());
+        served.shards.visit([&](std::size_t index, const std::vector<Event> &events)
+                            { sketches[index] = sketchEvents(events); });
+        for (std::size_t i = 1; i < sketches.size(); i++)
+            sketches.front().merge(sketches[i]);
+        printApproximateStats(sketches.front(), out);
+    }
+    else if (args[1] == "delete" && isFiltered && args.back() != "--dry-run")
+    {
+        if (auto filter = getFilterFromOption(args[2], args[3], out); filter.has_value())
+        {
+            // The delete is logged only if it is going to happen, so the matches are
+            // found first, within the time limit, and removed after.
+            std::unique_lock logLock(served.logMutex);
+            std::lock_guard lock(served.fileMutex);
+            const auto selected = served.shards.select(QueryPlan(Filter(filter.value())), control);
+            if (!selected.has_value())
+            {
+                reportStopped(control, out);
+            }
+            else if (!selected->empty())
+            {
+                std::string program;
+                filter->serialize(program);
+                if (!served.log->append(LogRecordType::Delete, program))
+                    out << "Unable to log the delete." << std::endl;
+                else if (const auto removed = served.shards.remove(filter.value(), QueryControl()); removed.has_value())
+                    out << "Deleted " << removed.value() << " events." << std::endl;
+            }
+        }
+        checkpointShardedEvents(served, eventsPath, layoutPath, false);
+    }
+    else
+    {
+        ServedEvents snapshot;
+        snapshot.events = served.shards.getEvents();
+        return protocol::encodeText(request.id, protocol::Status::Text,
+                                    runServedCommand(snapshot, eventsPath, layoutPath, request.words, request.timeout));
+    }
+    return protocol::encodeText(request.id, protocol::Status::Text, out.str());
+}
+
+// Executes one daemon request (see protocol.h) and returns the response. Queries
+// come with their filter compiled already and get their rows back packed; prepared
+// queries are kept in `prepared` and executed by handle. `run` executes the query
+// plans of the request (one for a query, any number for a multi-query), or its
+// command, against the events.
+std::string handleDaemonRequest(PreparedQueries &prepared, const std::string &payload,
+                                const std::function<std::string(const protocol::Request &, const std::vector<const QueryPlan *> &)> &run)
+{
+    std::string error;
+    auto request = protocol::decodeRequest(payload, error);
+    if (!request.has_value())
+        return protocol::encodeText(0, protocol::Status::Error, "Invalid request: " + error + "\n");
+
+    switch (request->op)
+    {
+    case protocol::Op::Query:
+    {
+        const QueryPlan plan(std::move(request->filter.value()));
+        return run(request.value(), {&plan});
+    }
+    case protocol::Op::MultiQuery:
+    {
+        std::vector<const QueryPlan *> pointers;
+        const auto plans = getQueryPlans(std::move(request->filters), pointers);
+        return run(request.value(), pointers);
+    }
+    case protocol::Op::Prepare:
+    {
+        const auto handle = prepared.prepare(std::move(request->filter.value()));
+        if (!handle.has_value())
+            return protocol::encodeText(request->id, protocol::Status::Error, "Too many prepared queries.\n");
+        return protocol::encodeHandle(request->id, handle.value());
+    }
+    case protocol::Op::Execute:
+    {
+        const auto today = getToday();
+        const auto plan = prepared.getPlan(request->handle, getDayNumberFromDate(std::chrono::year_month_day{today}));
+        if (plan == nullptr)
+            return protocol::encodeText(request->id, protocol::Status::Error, "No prepared query " + std::to_string(request->handle) + ".\n");
+        return run(request.value(), {plan.get()});
+    }
+    case protocol::Op::Release:
+        if (!prepared.release(request->handle))
+            return protocol::encodeText(request->id, protocol::Status::Error, "No prepared query " + std::to_string(request->handle) + ".\n");
+        return protocol::encodeText(request->id, protocol::Status::Text, "");
+    case protocol::Op::Command:
+        break;
+    }
+    return run(request.value(), {});
+}
+
+// Runs the daemon: serves `list`, `stats`, `add` and `delete --where/--match`
+// requests from any number of clients on the socket at `socketPath`, from
+// events kept in memory. Adds and deletes go to `log`, which is folded into
+// events.csv when it grows large and when the daemon stops. With `shardCount` above zero, the events are split
+// by date range across that many shard threads instead of being shared by the
+// workers under a lock.
+void serveEvents(std::vector<Event> events, std::filesystem::path eventsPath, std::filesystem::path layoutPath,
+                 std::filesystem::path socketPath, std::size_t workers, std::size_t shardCount, WriteAheadLog &log)
+{
+    Server::Options options;
+    options.socketPath = socketPath;
+    options.workers = workers;
+
+    ServedEvents served;
+    std::optional<ShardedServedEvents> sharded;
+    PreparedQueries prepared;
+    auto run = [&](const protocol::Request &request, const std::vector<const QueryPlan *> &plans)
+    {
+        return sharded.has_value() ? handleShardedRequest(sharded.value(), eventsPath, layoutPath, request, plans)
+                                   : handleRequest(served, eventsPath, layoutPath, request, plans);
+    };
+    Server server(options, [&](const std::string &payload)
+                  { return handleDaemonRequest(prepared, payload, run); });
+
+    // The shard threads start after the server, so that they inherit its signal mask.
+    if (shardCount > 0)
+    {
+        sharded.emplace(shardCount);
+        sharded->shards.load(std::move(events));
+        sharded->stamp = FileStamp::of(eventsPath);
+        sharded->log = &log;
+    }
+    else
+    {
+        served.events = std::move(events);
+        served.stamp = FileStamp::of(eventsPath);
+        served.log = &log;
+    }
+    std::cout << "Listening on " << socketPath.string() << std::endl;
+    if (!server.run())
+        std::exit(1);
+
+    // What was logged goes into events.csv now, so that the next start doesn't
+    // have to recover it.
+    if (sharded.has_value())
+        checkpointShardedEvents(sharded.value(), eventsPath, layoutPath, true);
+    else
+        checkpointServedEvents(served, eventsPath, layoutPath, true);
+}
+
+// Encodes the command line `args` as request `id`. A `list --where/--match` query
+// is compiled here, so that the daemon only runs the filter. `prepare --where/--match`
+// has the daemon keep the compiled filter and answers with a handle, which
+// `execute <handle>` runs and `release <handle>` forgets. `multi-query <file>` sends
+// the compiled queries of the file, whose text is kept in `expressions` for listing
+// the answer. Returns `std::nullopt` if a filter or handle is not valid.
+std::optional<std::string> getRemoteRequest(std::uint32_t id, const std::vector<std::string> &args, std::optional<std::chrono::milliseconds> timeout,
+                                            std::vector<std::string> &expressions)
+{
+    if ((args.size() == 2 || (args.size() == 4 && args[2] == "--output")) && args[0] == "multi-query")
+    {
+        std::vector<Filter> filters;
+        if (!readQueryFile(args[1], expressions, filters))
+            return std::nullopt;
+        return protocol::encodeMultiQuery(id, filters, timeout);
+    }
+    if (args.size() == 3 && (args[0] == "list" || args[0] == "prepare") && (args[1] == "--where" || args[1] == "--match"))
+    {
+        auto filter = getFilterFromOption(args[1], args[2]);
+        if (!filter.has_value())
+            return std::nullopt;
+        return args[0] == "list" ? protocol::encodeQuery(id, filter.value(), timeout) : protocol::encodePrepare(id, filter.value());
+    }
+    if (args.size() == 2 && (args[0] == "execute" || args[0] == "release"))
+    {
+        std::uint32_t handle = 0;
+        const auto [end, error] = std::from_chars(args[1].data(), args[1].data() + args[1].size(), handle);
+        if (error != std::errc() || end != args[1].data() + args[1].size())
+        {
+            std::cout << "Invalid query handle: " << args[1] << std::endl;
+            return std::nullopt;
+        }
+        return args[0] == "execute" ? protocol::encodeExecute(id, handle, timeout) : protocol::encodeRelease(id, handle);
+    }
+    return protocol::encodeCommand(id, args, timeout);
+}
+
+// Sends each command line of `commands` to the daemon listening on `socketPath` and
+// prints the responses in order. The requests are pipelined on one connection.
+// Returns false if the daemon can't be reached or a command is not valid.
+bool sendRemoteCommands(const std::vector<std::vector<std::string>> &commands, std::optional<std::chrono::milliseconds> timeout,
+                        const std::filesystem::path &socketPath)
+{
+    std::vector<std::string> requests;
+    std::vector<std::vector<std::string>> expressions(commands.size());
+    for (std::size_t i = 0; i < commands.size(); i++)
+    {
+        auto request = getRemoteRequest(static_cast<std::uint32_t>(i), commands[i], timeout, expressions[i]);
+        if (!request.has_value())
+            return false;
+        requests.push_back(std::move(request.value()));
+    }
+
+    const int fd = connectToServer(socketPath);
+    if (fd < 0)
+    {
+        std::cerr << "Unable to connect to " << socketPath.string() << ", is `days serve` running?" << std::endl;
+        return false;
+    }
+
+    const auto today = getToday();
+    std::uint32_t expected = 0;
+    bool valid = true;
+    bool listed = true; // the files of multi-queries with --output
+    auto print = [&](const std::string &payload)
+    {
+        const auto response = protocol::decodeResponse(payload);
+        if (!response.has_value() || response->id != expected++)
+        {
+            valid = false;
+            return false;
+        }
+        if (response->status == protocol::Status::Rows)
+            listEvents(response->events, today, 2, "", "", "", "", "", "");
+        else if (response->status == protocol::Status::RowSets)
+        {
+            const auto &args = commands[response->id];
+            const auto outputDirectory = args.size() == 4 ? std::optional<std::filesystem::path>(args[3]) : std::nullopt;
+            listed = listRowSets(expressions[response->id], response->events, response->rowSets, today, outputDirectory) && listed;
+        }
+        else if (response->status == protocol::Status::Handle)
+            std::cout << response->handle << std::endl;
+        else
+            display(response->text, response->status == protocol::Status::Error ? std::cerr : std::cout);
+        return true;
+    };
+    const bool exchanged = exchangeFrames(fd, requests, print);
+    close(fd);
+    if (!exchanged || !valid)
+    {
+        std::cerr << "Lost the connection to " << socketPath.string() << std::endl;
+        return false;
+    }
+    return listed;
+}
+
+// Appends the command line to the capture log named by DAYS_CAPTURE, if it is
+// set, when the command finishes. Timing starts at `started`, so reading the
+// events counts too.
+struct CommandCapture
+{
+    std::optional<std::string> logPath = getEnvironmentVariable("DAYS_CAPTURE");
+    CapturedCommand command;
+    std::chrono::steady_clock::time_point started;
+
+    ~CommandCapture()
+    {
+        if (!logPath.has_value() || logPath->empty())
+            return;
+        command.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+        if (!appendCapturedCommand(logPath.value(), command))
+            std::cerr << "Unable to write the capture log " << logPath.value() << std::endl;
+    }
+};
+
+// Runs the command `words` as a child process of this executable, with `home` as
+// its home directory, `today` as its date and its output discarded. The child
+// captures itself to `logPath`. Returns the exit status of the child, or -1 if
+// it didn't exit normally.
+int runReplayedCommand(const std::vector<std::string> &words, std::chrono::sys_days today, const std::filesystem::path &home,
+                       const std::filesystem::path &logPath)
+{
+    std::vector<char *> argv{const_cast<char *>("days")};
+    for (const auto &word : words)
+        argv.push_back(const_cast<char *>(word.c_str()));
+    argv.push_back(nullptr);
+    const std::string date = getStringFromDate(std::chrono::year_month_day{today});
+
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        setenv("HOME", home.c_str(), 1);
+        setenv("DAYS_TODAY", date.c_str(), 1);
+        setenv("DAYS_CAPTURE", logPath.c_str(), 1);
+        const int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+// Runs the commands captured in `logPath` again, in order, each one on the day it
+// was captured on, against a copy of the files in `dataPath`, and prints how long
+// each took compared to when it was captured. The commands run in child processes
+// of this executable, so a new build replays the traffic captured with an old one.
+// The copy lives in ~/.days/tmp while the replay runs and is removed afterwards.
+bool replayCommands(const std::filesystem::path &logPath, const std::filesystem::path &dataPath, const std::filesystem::path &daysPath)
+{
+    namespace fs = std::filesystem;
+    const auto commands = readCapturedCommands(logPath);
+    if (!commands.has_value())
+    {
+        std::cerr << "Unable to read " << logPath.string() << std::endl;
+        return false;
+    }
+
+    // The copy is the home directory of the replayed commands, so the real
+    // events are never touched.
+    const auto home = daysPath / "tmp" / ("replay-" + std::to_string(getpid()));
+    const auto replayLogPath = home / "replay.log";
+    std::error_code error;
+    fs::create_directories(home / ".days", error);
+    for (auto entry = fs::directory_iterator(dataPath, error); !error && entry != fs::directory_iterator(); entry.increment(error))
+    {
+        if (entry->is_regular_file())
+            fs::copy_file(entry->path(), home / ".days" / entry->path().filename(), error);
+    }
+    if (error)
+    {
+        std::cerr << "Unable to copy " << dataPath.string() << " to " << home.string() << ": " << error.message() << std::endl;
+        fs::remove_all(home, error);
+        return false;
+    }
+
+    std::ifstream replayLog;
+    std::chrono::microseconds recordedTotal{0};
+    std::chrono::microseconds replayedTotal{0};
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(6) << "#" << std::setw(14) << "captured us" << std::setw(14) << "replayed us" << std::setw(9) << "change"
+              << "  command" << std::endl;
+    for (std::size_t i = 0; i < commands->size(); i++)
+    {
+        const auto &command = commands.value()[i];
+        const int status = runReplayedCommand(command.words, command.today, home, replayLogPath);
+
+        // Each replayed command appends one line to the replay log, unless it failed before it finished.
+        std::optional<CapturedCommand> replayed;
+        if (!replayLog.is_open())
+            replayLog.open(replayLogPath);
+        replayLog.clear();
+        if (std::string line; std::getline(replayLog, line))
+            replayed = parseCapturedCommand(line);
+
+        std::ostringstream line;
+        for (const auto &word : command.words)
+            line << (line.tellp() > 0 ? " " : "") << word;
+        std::cout << std::setw(6) << i + 1 << std::setw(14) << command.elapsed.count();
+        if (replayed.has_value())
+        {
+            const double change = command.elapsed.count() > 0
+                                      ? 100.0 * static_cast<double>((replayed->elapsed - command.elapsed).count()) / static_cast<double>(command.elapsed.count())
+                                      : 0.0;
+            std::cout << std::setw(14) << replayed->elapsed.count() << std::setw(8) << std::showpos << change << std::noshowpos << "%";
+            recordedTotal += command.elapsed;
+            replayedTotal += replayed->elapsed;
+        }
+        else
+            std::cout << std::setw(14) << "-" << std::setw(9) << "-";
+        std::cout << "  " << line.str();
+        if (status != 0)
+            std::cout << " (exit " << status << ")";
+        std::cout << std::endl;
+    }
+
+    if (recordedTotal.count() > 0)
+    {
+        std::cout << std::setw(6) << "total" << std::setw(14) << recordedTotal.count() << std::setw(14) << replayedTotal.count()
+                  << std::setw(8) << std::showpos
+                  << 100.0 * static_cast<double>((replayedTotal - recordedTotal).count()) / static_cast<double>(recordedTotal.count())
+                  << std::noshowpos << "%" << std::endl;
+    }
+    fs::remove_all(home, error);
+    return true;
+}
+
+// Writes the completion index at `indexPath` from the categories and descriptions of `events`.
+void writeCompletionIndex(const std::filesystem::path &indexPath, const std::filesystem::path &eventsPath, const std::vector<Event> &events)
+{
+    std::vector<std::string> categories;
+    std::vector<std::string> descriptions;
+    categories.reserve(events.size());
+    descriptions.reserve(events.size());
+    for (const auto &event : events)
+    {
+        categories.emplace_back(event.getCategory());
+        descriptions.emplace_back(event.getDescription());
+    }
+    if (!CompletionIndex::write(indexPath, eventsPath, std::move(categories), std::move(descriptions)))
+        std::cerr << "Unable to write " << indexPath.string() << std::endl;
+}
+
+// Prints completion candidates, one per line, for the partially typed command line
+// `words` (the arguments after `days`, the last one being the word being completed).
+// Categories and descriptions come from the completion index, never from events.csv.
+void completeArguments(const std::vector<std::string> &words, const std::filesystem::path &indexPath, std::chrono::sys_days today)
+{
+    constexpr std::size_t maxCandidates = 50;
+    const std::vector<std::string> commands{"list", "add", "delete", "watch", "stats", "compact", "prune", "shell", "serve", "remote", "replay", "sort", "dedupe", "diff", "remind", "multi-query", "show", "complete"};
+    const std::map<std::string, std::vector<std::string>> commandOptions{
+        {"list", {"--where", "--match", "--timeout", "--all", "--today", "--before-date", "--after-date", "--date", "--category", "--categories", "--exclude", "--description", "--no-category"}},
+        {"watch", {"--all", "--today", "--before-date", "--after-date", "--date", "--category", "--categories", "--exclude", "--description", "--no-category"}},
+        {"add", {"--date", "--category", "--description"}},
+        {"stats", {"--approx"}},
+        {"delete", {"--where", "--match", "--timeout", "--date", "--category", "--description", "--all", "--row", "--dry-run"}},
+        {"show", {"--row"}},
+        {"replay", {"--data"}},
+        {"sort", {"--memory-limit"}},
+        {"dedupe", {"--memory-limit"}},
+        {"diff", {"--memory-limit"}},
+        {"compact", {"--memory-limit"}},
+        {"remind", {"list", "add", "remove", "run"}},
+        {"multi-query", {"--output", "--timeout"}},
+    };
+
+    const std::string partial = words.empty() ? "" : words.back();
+    const std::string previous = words.size() > 1 ? words.at(words.size() - 2) : "";
+    std::vector<std::string> candidates;
+
+    if (words.size() <= 1)
+    {
+        candidates = commands;
+    }
+    else if (previous == "--category" || previous == "--categories")
+    {
+        // For a comma-separated list, complete the last category and keep the ones before it.
+        const auto comma = previous == "--categories" ? partial.rfind(',') : std::string::npos;
+        const std::string head = comma == std::string::npos ? "" : partial.substr(0, comma + 1);
+        for (auto &category : CompletionIndex(indexPath).getCategories(partial.substr(head.size()), maxCandidates))
+        {
+            if (!category.empty())
+                candidates.push_back(head + category);
+        }
+    }
+    else if (previous == "--description")
+    {
+        candidates = CompletionIndex(indexPath).getDescriptions(partial, maxCandidates);
+    }
+    else if (previous == "--date" || previous == "--before-date" || previous == "--after-date")
+    {
+        candidates.push_back(getStringFromDate(std::chrono::year_month_day{today}));
+    }
+    else if (commandOptions.contains(words.front()))
+    {
+        candidates = commandOptions.at(words.front());
+    }
+
+    for (const auto &candidate : candidates)
+    {
+        if (candidate.starts_with(partial))
+        {
+            display(candidate);
+            display('\n');
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace std;
+
+    // Captured commands are timed from the start, including reading the events.
+    const auto started = chrono::steady_clock::now();
+
+    // Get the current date and extract year_month_day.
+    // See https://en.cppreference.com/w/cpp/chrono/year_month_day
+    const chrono::year_month_day currentDate{getToday()};
+
+    // Note that you can't print an `std::chrono::year_month_day`
+    // with `display()` because there is no overloaded << operator
+    // for it (yet).
+
+    // Construct a path for the events file.
+    // If the user's home directory can't be determined, give up.
+    std::string homeDirectoryString = getHomeDirectory();
+    if (homeDirectoryString == "")
+        return 1;
+
+    // `--timeout` can be given in the place of any option, so take it out before the
+    // positional options are assigned.
+    vector<string> args(argv, argv + argc);
+    const vector<string> commandLine(argv + 1, argv + argc);
+    std::optional<std::chrono::milliseconds> timeout;
+    if (!takeTimeoutOption(args, timeout))
+        return 1;
+    argc = static_cast<int>(args.size());
+
+    // Using ternary operators variables can be assigned with args values depending on the value of
+    // argc without repeating if statements. Default assignment is an empty string
+    std::string final = (argc > 0) ? args[argc - 1] : "";
+    std::string command = (argc > 1) ? args[1] : "";
+    std::string option1 = (argc > 2) ? args[2] : "";
+    std::string parameter1 = (argc > 3) ? args[3] : "";
+    std::string option2 = (argc > 4) ? args[4] : "";
+    std::string parameter2 = (argc > 5) ? args[5] : "";
+    std::string option3 = (argc > 6) ? args[6] : "";
+    std::string parameter3 = (argc > 7) ? args[7] : "";
+
+    namespace fs = std::filesystem; // save a little typing
+    fs::path daysPath{homeDirectoryString};
+    daysPath /= ".days"; // append our own directory
+    const auto indexPath = daysPath / "completion.idx";
+
+    // Completion has to be instant, so it is answered from the completion
+    // index alone, before anything else is read.
+    if (command == "complete")
+    {
+        completeArguments(vector<string>(args.begin() + 2, args.end()), indexPath, chrono::sys_days{currentDate});
+        return 0;
+    }
+
+    // The daemon has the events loaded already, so the client doesn't read anything.
+    // `remote --batch <file>` sends every command line in the file at once.
+    if (command == "remote")
+    {
+        vector<vector<string>> commands;
+        if (option1 == "--batch" && argc == 4)
+        {
+            ifstream file(parameter1);
+            for (string line; getline(file, line);)
+            {
+                if (auto words = splitCommandLine(line); !words.empty())
+                    commands.push_back(std::move(words));
+            }
+        }
+        else
+            commands.emplace_back(args.begin() + 2, args.end());
+        return sendRemoteCommands(commands, timeout, daysPath / "days.sock") ? 0 : 1;
+    }
+
+    if (!fs::exists(daysPath))
+    {
+        display(daysPath.string());
+        display(" does not exist, please create it");
+        newline();
+        return 1; // nothing to do anymore, exit program
+
+        // To create the directory:
+        // std::filesystem::create_directory(daysPath);
+        // See issue: https://github.com/jerekapyaho/days_cpp/issues/4
+    }
+
+    // The long-running commands can't be replayed, so they are not captured.
+    std::optional<CommandCapture> capture;
+    if (argc > 1 && command != "watch" && command != "shell" && command != "serve" && command != "replay" &&
+        !(command == "remind" && option1 == "run"))
+    {
+        capture.emplace();
+        capture->command = {getToday(), {}, commandLine};
+        capture->started = started;
+    }
+
+    // `replay <log> [--data <directory>]` only runs other commands, against a copy
+    // of ~/.days or of the directory given.
+    if (command == "replay" && (argc == 3 || (argc == 5 && option2 == "--data")))
+        return replayCommands(option1, argc == 5 ? fs::path{parameter2} : daysPath, daysPath) ? 0 : 1;
+
+    // A daemon logs its changes to events.wal and folds them into events.csv now
+    // and then (see wal.h). Whatever one left in the log when it stopped is folded
+    // in first. While one is running, it has the log, and the events are events.csv
+    // with the log applied; only the daemon may rewrite the file then.
+    const auto logPath = daysPath / "events.wal";
+    std::unique_ptr<WriteAheadLog> log;
+    bool daemonRunning = false;
+    if (command == "serve" || fs::exists(logPath))
+    {
+        std::string error;
+        log = WriteAheadLog::open(logPath, error, daemonRunning);
+        if (log == nullptr && (command == "serve" || !daemonRunning))
+        {
+            std::cerr << "Unable to open the log: " << error << std::endl;
+            return 1;
+        }
+        if (log != nullptr && !recoverLoggedEvents(*log, daysPath / "events.csv", daysPath / "events.meta"))
+        {
+            std::cerr << "Unable to fold the log into events.csv" << std::endl;
+            return 1;
+        }
+        if (command != "serve")
+            log.reset();
+    }
+    const bool rewrites = command == "compact" || command == "prune" || command == "sort" || command == "dedupe" || command == "shell" ||
+                          (command == "delete" && final != "--dry-run");
+    if (daemonRunning && rewrites)
+    {
+        std::cout << "The daemon is running, so events.csv can't be rewritten; stop it first";
+        std::cout << (command == "delete" ? ", or use `days remote delete --where`." : ".") << std::endl;
+        return 1;
+    }
+    // An append could land between the daemon reading the file and folding its log
+    // over it, so adds go through the daemon too.
+    if (daemonRunning && command == "add")
+    {
+        std::cout << "The daemon is running, so events.csv can't be changed; use `days remote add`." << std::endl;
+        return 1;
+    }
+
+    // The reminder rules are kept apart from the events, and `remind run` reloads
+    // the events itself whenever they change.
+    if (command == "remind")
+        return remindEvents(args, daysPath, Config::load(daysPath / "config")) ? 0 : 1;
+
+    // Now we should have a valid path to the `~/.days` directory.
+    // Construct a pathname for the `events.csv` file.
+    auto eventsPath = daysPath / "events.csv";
+
+    // These stream the rows instead of loading them, so that they work on files
+    // bigger than memory.
+    if (command == "sort" || command == "dedupe" || command == "diff" || (command == "compact" && option1 == "--memory-limit"))
+    {
+        // Only compaction expires events, so only it depends on the policy being valid.
+        const auto policy = command == "compact" ? getRetentionPolicy(Config::load(daysPath / "config")) : RetentionPolicy{};
+        if (!policy.has_value())
+            return 1;
+        return sortEventsExternally(args, daysPath, policy.value(), getToday()) ? 0 : 1;
+    }
+    if (command == "stats" && option1 == "--approx")
+        return statsEventsApproximately(eventsPath) ? 0 : 1;
+    if (command == "show" && option1 == "--row" && argc == 4)
+        return showRow(eventsPath, daysPath / "events.rows", parameter1, getToday()) ? 0 : 1;
+    if (command == "delete" && option1 == "--row" && argc == 4)
+        return deleteRow(eventsPath, daysPath / "events.meta", daysPath / "events.rows", parameter1) ? 0 : 1;
+    if (command == "delete" && argc > 2 && option1 != "--where" && option1 != "--match" && final != "--dry-run")
+        return deleteMatchingRows(eventsPath, daysPath / "events.meta", option1, parameter1, option2, parameter2, option3, parameter3) ? 0 : 1;
+
+    // Read in the events, remembering how much of the file was consumed. With a
+    // daemon running, its log goes on top; if it folds the log into the file
+    // meanwhile, both are read again.
+    uintmax_t eventsBytes{0};
+    vector<Event> events;
+    size_t loggedRecords{0};
+    while (true)
+    {
+        const auto eventsStamp = FileStamp::of(eventsPath);
+        events = loadEvents(eventsPath, &eventsBytes);
+        if (!daemonRunning)
+            break;
+        const auto records = WriteAheadLog::read(logPath);
+        if (FileStamp::of(eventsPath) == eventsStamp)
+        {
+            loggedRecords = applyLogRecords(events, records, eventsStamp);
+            break;
+        }
+    }
+
+    const Config config = Config::load(daysPath / "config");
+
+    // Only the rows added since the last compaction need sorting; they are merged
+    // with the sorted base so that range queries can use binary search.
+    const auto layoutPath = daysPath / "events.meta";
+    const bool sorted = mergeTail(events, readBaseRows(layoutPath));
+
+    // The events were read anyway, so this is the cheap moment to bring the
+    // completion index up to date if the file has changed since it was written.
+    if (!CompletionIndex(indexPath).isCurrent(eventsPath))
+        writeCompletionIndex(indexPath, eventsPath, events);
+
+    const auto today = getToday();
+
+    if (argc > 1)
+    {
+        if (command == "list" && (option1 == "--where" || option1 == "--match") && argc > 3)
+        {
+            if (auto filter = getFilterFromOption(option1, parameter1); filter.has_value())
+            {
+                const QueryControl control = timeout.has_value() ? QueryControl(timeout.value()) : QueryControl();
+                if (final == "--explain")
+                    display(filter->disassemble());
+                else
+                    listEventsWhere(events, filter.value(), today, control);
+            }
+        }
+        else if (command == "multi-query" && (argc == 3 || (argc == 5 && parameter1 == "--output")))
+        {
+            const QueryControl control = timeout.has_value() ? QueryControl(timeout.value()) : QueryControl();
+            const auto outputDirectory = argc == 5 ? std::optional<fs::path>(option2) : std::nullopt;
+            if (!multiQueryEvents(events, option1, outputDirectory, today, control))
+                return 1;
+        }
+        else if (command == "delete" && (option1 == "--where" || option1 == "--match") && argc > 3)
+        {
+            if (auto filter = getFilterFromOption(option1, parameter1); filter.has_value())
+            {
+                const QueryControl control = timeout.has_value() ? QueryControl(timeout.value()) : QueryControl();
+                deleteEventsWhere(std::move(events), filter.value(), today, eventsPath, layoutPath, final == "--dry-run", control);
+            }
+        }
+        else if (command == "list")
+        {
+            // The saved cracker describes events.csv alone, which the log's records
+            // change without changing the file's stamp.
+            const auto crackerPath = loggedRecords == 0 ? std::optional<fs::path>(daysPath / "events.crack") : std::nullopt;
+            if (!listEventsInRange(events, sorted, today, crackerPath, eventsPath, argc, option1, parameter1, option2, parameter2))
+                listEvents(events, today, argc, option1, parameter1, option2, parameter2, option3, parameter3);
+        }
+        else if (command == "add" && (argc == 6 || argc == 8))
+        {
+            // A row index that was current before the row is appended only needs
+            // the new row; any other one is rebuilt when it is next used.
+            const auto rowsPath = daysPath / "events.rows";
+            const auto eventsStamp = FileStamp::of(eventsPath);
+            auto rowIndex = eventsStamp.has_value() ? RowIndex::load(rowsPath, eventsStamp.value()) : std::nullopt;
+            auto added = addEvents(eventsPath, today, argc, option1, parameter1, option2, parameter2, option3, parameter3);
+            if (added.has_value())
+            {
+                events.push_back(added.value());
+                writeCompletionIndex(indexPath, eventsPath, events);
+                if (rowIndex.has_value())
+                    rowIndex->extend(rowsPath, eventsPath);
+            }
+        }
+        else if (command == "delete" && argc > 2)
+        {
+            deleteEvents(events, today, eventsPath, layoutPath, option1, parameter1, option2, parameter2, option3, parameter3, final);
+        }
+        else if (command == "watch")
+        {
+            watchEvents(std::move(events), eventsBytes, eventsPath, argc, option1, parameter1, option2, parameter2, option3, parameter3);
+        }
+        else if (command == "stats")
+        {
+            statsEvents(events, today);
+        }
+        else if (command == "compact")
+        {
+            const auto policy = getRetentionPolicy(config);
+            if (!policy.has_value())
+                return 1;
+            compactEvents(std::move(events), sorted, eventsPath, layoutPath, policy.value(), today);
+        }
+        else if (command == "prune")
+        {
+            const auto policy = getRetentionPolicy(config);
+            if (!policy.has_value())
+                return 1;
+            pruneEvents(std::move(events), sorted, eventsPath, layoutPath, policy.value(), today);
+        }
+        else if (command == "shell")
+        {
+            shellEvents(std::move(events), eventsPath, layoutPath);
+        }
+        else if (command == "serve")
+        {
+            // Both are bounded well above any useful value, so that a typo can't ask
+            // for millions of threads.
+            size_t workers = 4;
+            size_t shards = 0;
+            for (int i = 2; i + 1 < argc; i += 2)
+            {
+                if (args[i] != "--workers" && args[i] != "--shards")
+                    continue;
+                const size_t limit = args[i] == "--workers" ? 256 : 1024;
+                size_t value = 0;
+                const auto [end, code] = from_chars(args[i + 1].data(), args[i + 1].data() + args[i + 1].size(), value);
+                if (code != errc{} || end != args[i + 1].data() + args[i + 1].size() || value > limit)
+                {
+                    cerr << "Invalid " << args[i] << ": " << args[i + 1] << " (expected a number up to " << limit << ")" << endl;
+                    return 1;
+                }
+                (args[i] == "--workers" ? workers : shards) = value;
+            }
+            serveEvents(std::move(events), eventsPath, layoutPath, daysPath / "days.sock", std::max<size_t>(workers, 1), shards, *log);
         }
         else
             std::cout << "Invalid command." << std::endl;
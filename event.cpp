@@ -1,13 +1,267 @@
 #include "event.h"
 
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string_view>
+#include <stdexcept>
+#include <charconv>
+#include <cctype>
+#include <cstdlib>
+
+Event::Event(const std::chrono::year_month_day& t, std::string_view c, std::string_view d, std::optional<std::chrono::minutes> time) :
+    category(c), description(d), packed(::getMinuteNumber(t, time) * 2 + time.has_value()) {
+
+}
+
 std::chrono::year_month_day Event::getTimestamp() const {
-    return timestamp;
+    return std::chrono::year_month_day{std::chrono::sys_days{std::chrono::days{getDayNumber()}}};
 }
 
-std::string Event::getCategory() const {
+const PrefixString& Event::getCategory() const {
     return category;
 }
 
-std::string Event::getDescription() const {
+const PrefixString& Event::getDescription() const {
     return description;
 }
+
+std::optional<std::chrono::minutes> Event::getTime() const {
+    if ((packed & 1) == 0) {
+        return std::nullopt;
+    }
+    return std::chrono::minutes{getMinuteNumber() - getDayNumber() * minutesPerDay};
+}
+
+// Parses the string `buf` for a date in YYYY-MM-DD format. If `buf` can be parsed,
+// returns a wrapped `std::chrono::year_month_day` instances, otherwise `std::nullopt`.
+// NOTE: Once clang++ and g++ implement chrono::from_stream, this could be replaced by
+// something like this:
+//  chrono::year_month_day birthdate;
+//  std::istringstream bds{birthdateValue};
+//  std::basic_istream<char> stream{bds.rdbuf()};
+//  chrono::from_stream(stream, "%F", birthdate);
+// However, from_stream goes through a stream and a locale for every date, and
+// the dates of every row are parsed on every load, so the fixed positions of the
+// digits are read directly instead.
+
+std::optional<std::chrono::year_month_day> getDateFromString(const std::string &buf)
+{
+    const auto dateTime = getDateTimeFromString(buf);
+    if (!dateTime.has_value() || dateTime->time.has_value())
+    {
+        return std::nullopt;
+    }
+    return dateTime->date;
+}
+
+// Reads the `length` digits at `position` of `buf` into `value`. Returns false if
+// they are not all digits.
+template <typename T>
+static bool getDigits(std::string_view buf, std::size_t position, std::size_t length, T &value)
+{
+    const char *first = buf.data() + position;
+    const char *last = first + length;
+    const auto [rest, error] = std::from_chars(first, last, value);
+    return error == std::errc{} && rest == last && std::isdigit(static_cast<unsigned char>(*first));
+}
+
+std::optional<DateTime> getDateTimeFromString(std::string_view buf)
+{
+    using namespace std; // use std facilities without prefix inside this function
+
+    constexpr string_view yyyymmdd = "YYYY-MM-DD";
+    constexpr string_view yyyymmddThhmm = "YYYY-MM-DDTHH:MM";
+    if (buf.size() != yyyymmdd.size() && buf.size() != yyyymmddThhmm.size())
+    {
+        return nullopt;
+    }
+
+    int year{0};
+    unsigned int month{0};
+    unsigned int day{0};
+    if (buf[4] != '-' || buf[7] != '-' || !getDigits(buf, 0, 4, year) || !getDigits(buf, 5, 2, month) || !getDigits(buf, 8, 2, day))
+    {
+        return nullopt;
+    }
+    const auto date = chrono::year_month_day{chrono::year{year}, chrono::month(month), chrono::day(day)};
+    if (!date.ok())
+    {
+        return nullopt;
+    }
+    if (buf.size() == yyyymmdd.size())
+    {
+        return DateTime{date, nullopt};
+    }
+
+    int hours{0};
+    int minutes{0};
+    if (buf[10] != 'T' || buf[13] != ':' || !getDigits(buf, 11, 2, hours) || !getDigits(buf, 14, 2, minutes) || hours > 23 || minutes > 59)
+    {
+        return nullopt;
+    }
+    return DateTime{date, chrono::minutes{hours * 60 + minutes}};
+}
+
+// Returns `date` as a string in `YYYY-MM-DD` format.
+// The ostream support for `std::chrono::year_month_day` is not
+// available in most (any?) compilers, so we roll our own.
+std::string getStringFromDate(const std::chrono::year_month_day &date)
+{
+    std::ostringstream result;
+
+    result
+        << std::setfill('0') << std::setw(4) << static_cast<int>(date.year())
+        << "-" << std::setfill('0') << std::setw(2) << static_cast<unsigned>(date.month())
+        << "-" << std::setfill('0') << std::setw(2) << static_cast<unsigned>(date.day());
+
+    return result.str();
+}
+
+std::int32_t getDayNumberFromDate(const std::chrono::year_month_day &date)
+{
+    return static_cast<std::int32_t>(std::chrono::sys_days{date}.time_since_epoch().count());
+}
+
+std::chrono::sys_days getToday()
+{
+    if (const char *value = std::getenv("DAYS_TODAY"); value != nullptr)
+    {
+        if (const auto date = getDateFromString(value); date.has_value())
+            return std::chrono::sys_days{date.value()};
+    }
+    return std::chrono::floor<std::chrono::days>(std::chrono::system_clock::now());
+}
+
+std::string getStringFromDateTime(const std::chrono::year_month_day &date, std::optional<std::chrono::minutes> time)
+{
+    std::string result = getStringFromDate(date);
+    if (time.has_value())
+    {
+        const auto minutes = time->count();
+        result += 'T';
+        result += static_cast<char>('0' + minutes / 600);
+        result += static_cast<char>('0' + minutes / 60 % 10);
+        result += ':';
+        result += static_cast<char>('0' + minutes % 60 / 10);
+        result += static_cast<char>('0' + minutes % 10);
+    }
+    return result;
+}
+
+std::string getStringFromDateTime(const Event &event)
+{
+    return getStringFromDateTime(event.getTimestamp(), event.getTime());
+}
+
+// Appends `field` to `row`, quoted if it has a comma or a quote, so that
+// `getFieldsFromRow` reads it back as it was.
+static void appendField(std::string &row, std::string_view field)
+{
+    if (field.find_first_of(",\"") == std::string_view::npos)
+    {
+        row += field;
+        return;
+    }
+    row += '"';
+    for (const char c : field)
+    {
+        if (c == '"')
+            row += '"';
+        row += c;
+    }
+    row += '"';
+}
+
+std::string getRowFromEvent(const Event &event)
+{
+    std::string row = getStringFromDateTime(event);
+    row.reserve(row.size() + event.getCategory().size() + event.getDescription().size() + 2);
+    row += ',';
+    appendField(row, event.getCategory().view());
+    row += ',';
+    appendField(row, event.getDescription().view());
+    return row;
+}
+
+std::vector<std::string> getFieldsFromRow(std::string_view row)
+{
+    // A quote only opens or closes a quoted stretch at the start of a field or in
+    // one that started with a quote, as in RapidCSV.
+    std::vector<std::string> fields;
+    std::string field;
+    bool quoted = false;
+    auto unquote = [](std::string &field)
+    {
+        if (field.size() < 2 || field.front() != '"' || field.back() != '"')
+            return;
+        std::string unquoted;
+        unquoted.reserve(field.size() - 2);
+        for (std::size_t i = 1; i + 1 < field.size(); i++)
+        {
+            unquoted += field[i];
+            if (field[i] == '"' && field[i + 1] == '"' && i + 2 < field.size())
+                i++;
+        }
+        field = std::move(unquoted);
+    };
+    for (const char c : row)
+    {
+        if (c == '"')
+        {
+            if (field.empty() || field.front() == '"')
+                quoted = !quoted;
+            field += c;
+        }
+        else if (c == ',' && !quoted)
+        {
+            unquote(field);
+            fields.push_back(std::move(field));
+            field.clear();
+        }
+        else if (c != '\r')
+        {
+            field += c;
+        }
+    }
+    unquote(field);
+    fields.push_back(std::move(field));
+    return fields;
+}
+
+std::optional<Event> getEventFromRow(std::string_view row)
+{
+    // Most rows have neither quotes nor carriage returns, and are split in place.
+    if (row.find_first_of("\"\r") == std::string_view::npos)
+    {
+        const auto firstComma = row.find(',');
+        if (firstComma == std::string_view::npos)
+            return std::nullopt;
+        const auto secondComma = row.find(',', firstComma + 1);
+        if (secondComma == std::string_view::npos)
+            return std::nullopt;
+        const auto date = getDateTimeFromString(row.substr(0, firstComma));
+        if (!date.has_value())
+            return std::nullopt;
+        return Event{date->date, row.substr(firstComma + 1, secondComma - firstComma - 1), row.substr(secondComma + 1), date->time};
+    }
+
+    auto fields = getFieldsFromRow(row);
+    if (fields.size() < 3)
+        return std::nullopt;
+    const auto date = getDateTimeFromString(fields[0]);
+    if (!date.has_value())
+        return std::nullopt;
+    for (std::size_t i = 3; i < fields.size(); i++)
+    {
+        fields[2] += ',';
+        fields[2] += fields[i];
+    }
+    return Event{date->date, fields[1], fields[2], date->time};
+}
+
+std::int64_t getMinuteNumber(const std::chrono::year_month_day &date, std::optional<std::chrono::minutes> time)
+{
+    return std::int64_t{getDayNumberFromDate(date)} * 1440 + time.value_or(std::chrono::minutes{0}).count();
+}
@@ -1,30 +1,113 @@
 #pragma once
 
+#include "prefixstring.h"
+
 #include <string>
 #include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
 
-// Represents an event.
+// Represents an event. An event can have a time of day, to order the events
+// of the same day; an event without one is at the start of its day. The date
+// and time are kept packed as the minute number (see `getMinuteNumber`), so
+// ordering events by time is a comparison of two integers. The category and
+// description are prefix strings (see prefixstring.h), so comparing them
+// rarely leaves the event.
 class Event {
 public:
     Event(
         const std::chrono::year_month_day& t,
-        const std::string& c,
-        const std::string& d) :
-            timestamp(t), category(c), description(d) {
-
-    }
+        std::string_view c,
+        std::string_view d,
+        std::optional<std::chrono::minutes> time = std::nullopt);
 
     // Getters for the properties:
     std::chrono::year_month_day getTimestamp() const;
-    std::string getCategory() const;
-    std::string getDescription() const;
+    const PrefixString& getCategory() const;
+    const PrefixString& getDescription() const;
+
+    // Returns the time of day as minutes since midnight, if the event has one.
+    std::optional<std::chrono::minutes> getTime() const;
+
+    // Returns the date as the number of days since 1970-01-01, see `getDayNumberFromDate`.
+    std::int32_t getDayNumber() const {
+        // Rounded down, for the days before 1970.
+        const std::int64_t minuteNumber = getMinuteNumber();
+        return static_cast<std::int32_t>((minuteNumber >= 0 ? minuteNumber : minuteNumber - (minutesPerDay - 1)) / minutesPerDay);
+    }
+
+    // Returns the date and time as the number of minutes since 1970-01-01T00:00.
+    std::int64_t getMinuteNumber() const { return packed >> 1; }
 
     // Overloaded operator for output stream use.
     // Needs to be `friend`, not a method in this class.
     friend std::ostream& operator<<(std::ostream& os, const Event& event);
 
 private:
-    std::chrono::year_month_day timestamp;
-    std::string category;
-    std::string description;
+    static constexpr std::int64_t minutesPerDay = 24 * 60;
+
+    PrefixString category;
+    PrefixString description;
+    // The minute number shifted left by one, with the lowest bit set if the event
+    // has a time. Without one, the minute number is the start of the day.
+    std::int64_t packed;
+};
+
+// Parses `buf` for a date in YYYY-MM-DD format. Returns `std::nullopt` if it can't be parsed.
+std::optional<std::chrono::year_month_day> getDateFromString(const std::string &buf);
+
+// Returns `date` as a string in `YYYY-MM-DD` format.
+std::string getStringFromDate(const std::chrono::year_month_day &date);
+
+// A date with an optional time of day, as written in events.csv.
+struct DateTime {
+    std::chrono::year_month_day date;
+    std::optional<std::chrono::minutes> time; // since midnight
 };
+
+// Parses `buf` for a date in `YYYY-MM-DD` or a date and time in `YYYY-MM-DDTHH:MM`
+// format. Returns `std::nullopt` if it can't be parsed.
+std::optional<DateTime> getDateTimeFromString(std::string_view buf);
+
+// Returns `date` as a string in `YYYY-MM-DD` format, or `YYYY-MM-DDTHH:MM` with a `time`.
+std::string getStringFromDateTime(const std::chrono::year_month_day &date, std::optional<std::chrono::minutes> time);
+
+// Returns the date and time of `event` in the format of events.csv.
+std::string getStringFromDateTime(const Event &event);
+
+// Returns `event` as a `date,category,description` row of events.csv, without a
+// newline. A field with a comma or a quote is quoted, see `getFieldsFromRow`.
+std::string getRowFromEvent(const Event &event);
+
+// Splits a row of events.csv, without its newline, into its fields the way
+// RapidCSV reads them: a field that starts with a quote runs to the matching
+// quote, commas in it included, and loses its quotes, with `""` read as `"`.
+// Carriage returns are dropped.
+std::vector<std::string> getFieldsFromRow(std::string_view row);
+
+// Parses a `date,category,description` row of events.csv, without its newline.
+// The fields after a third one, from commas that weren't quoted, are part of the
+// description. Returns `std::nullopt` if the row has fewer than three fields or
+// the date can't be parsed. This is how every reader of events.csv parses a row.
+std::optional<Event> getEventFromRow(std::string_view row);
+
+// Returns `date` as the number of days since 1970-01-01, which is how the
+// indexes and filters compare dates.
+std::int32_t getDayNumberFromDate(const std::chrono::year_month_day &date);
+
+// Returns today's date. Setting DAYS_TODAY to a date in `YYYY-MM-DD` format
+// overrides it, which is how replayed commands see the day they were captured on.
+std::chrono::sys_days getToday();
+
+// Returns `date` at `time` as the number of minutes since 1970-01-01T00:00,
+// which is how events are ordered and the filters compare times. Without a
+// time, it is the start of the day. The minute numbers of the years after 6053
+// don't fit in 32 bits.
+std::int64_t getMinuteNumber(const std::chrono::year_month_day &date, std::optional<std::chrono::minutes> time);
+
+// Returns the minute number of `event`, see above.
+inline std::int64_t getMinuteNumber(const Event &event) {
+    return event.getMinuteNumber();
+}
@@ -0,0 +1,396 @@
+#include "extsort.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <unistd.h>
+
+#include "event.h"
+
+namespace {
+
+// Below this, reading a run costs more in system calls than in copying, so
+// runs are merged in several passes instead of all at once.
+constexpr std::size_t minimumReadBuffer = std::size_t{256} << 10;
+
+struct Row {
+    std::int64_t minute = 0;
+    std::string text;
+};
+
+// Returns the minute number of the date (and time) that starts `row`, or
+// `std::nullopt` if there is none.
+std::optional<std::int64_t> getRowMinute(std::string_view row) {
+    const auto comma = row.find(',');
+    if (comma == std::string_view::npos) {
+        return std::nullopt;
+    }
+    const auto dateTime = getDateTimeFromString(row.substr(0, comma));
+    if (!dateTime.has_value()) {
+        return std::nullopt;
+    }
+    return getMinuteNumber(dateTime->date, dateTime->time);
+}
+
+bool isBefore(const Row& a, const Row& b, RowOrder order) {
+    if (a.minute != b.minute) {
+        return a.minute < b.minute;
+    }
+    return order == RowOrder::ByRow && a.text < b.text;
+}
+
+// A file read line by line through a buffer of a given size.
+class LineReader {
+public:
+    LineReader(const std::filesystem::path& path, std::size_t bufferSize) : buffer(bufferSize) {
+        file.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        file.open(path, std::ios::binary);
+    }
+
+    bool isOpen() const { return file.is_open(); }
+
+    // Reads the next line, without its line ending, into `line`.
+    bool next(std::string& line) {
+        if (!std::getline(file, line)) {
+            return false;
+        }
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        return true;
+    }
+
+private:
+    std::vector<char> buffer; // declared first, so it outlives the stream using it
+    std::ifstream file;
+};
+
+// A file written through a buffer of a given size.
+class LineWriter {
+public:
+    LineWriter(const std::filesystem::path& path, std::size_t bufferSize) : buffer(bufferSize) {
+        file.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        file.open(path, std::ios::binary | std::ios::trunc);
+    }
+
+    void write(std::string_view line) {
+        file.write(line.data(), static_cast<std::streamsize>(line.size()));
+        file.put('\n');
+    }
+
+    // Flushes the file and returns true if everything was written.
+    bool close() {
+        file.close();
+        return !file.fail();
+    }
+
+private:
+    std::vector<char> buffer;
+    std::ofstream file;
+};
+
+// A sorted run being merged, positioned at its next row.
+struct RunCursor {
+    std::unique_ptr<LineReader> reader;
+    Row row;
+
+    bool advance() {
+        while (reader->next(row.text)) {
+            if (const auto minute = getRowMinute(row.text); minute.has_value()) {
+                row.minute = minute.value();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Sorts rows into runs and merges them, deleting the run files when done.
+class ExternalSort {
+public:
+    ExternalSort(const SortOptions& options, SortResult& result)
+        : options(options), result(result),
+          ioBuffer(std::clamp<std::size_t>(options.memoryLimit / 16, std::size_t{64} << 10, std::size_t{4} << 20)) {}
+
+    ~ExternalSort() {
+        std::error_code error;
+        for (const auto& run : runs) {
+            std::filesystem::remove(run, error);
+        }
+    }
+
+    bool sort(const std::filesystem::path& input, const std::filesystem::path& output, std::string& error) {
+        LineReader reader(input, ioBuffer);
+        if (!reader.isOpen()) {
+            error = "unable to read " + input.string();
+            return false;
+        }
+        std::string header;
+        if (!reader.next(header)) {
+            header = "date,category,description";
+        }
+
+        // The rows take what is left of the memory limit after the read and write buffers.
+        const std::size_t budget = options.memoryLimit > 3 * ioBuffer ? options.memoryLimit - 2 * ioBuffer : ioBuffer;
+        std::vector<Row> rows;
+        std::size_t bytes = 0;
+        std::string line;
+        while (reader.next(line)) {
+            if (std::all_of(line.begin(), line.end(), [](unsigned char c) { return std::isspace(c); })) {
+                continue;
+            }
+            const auto minute = getRowMinute(line);
+            if (!minute.has_value()) {
+                result.invalid++;
+                continue;
+            }
+            if (options.keep && !options.keep(line)) {
+                result.filtered++;
+                continue;
+            }
+            rows.push_back({minute.value(), line});
+            bytes += sizeof(Row) + rows.back().text.capacity();
+            if (bytes >= budget) {
+                if (!spill(rows, error)) {
+                    return false;
+                }
+                rows.clear();
+                rows.shrink_to_fit();
+                bytes = 0;
+            }
+        }
+
+        auto tempPath = output;
+        tempPath += ".tmp";
+        LineWriter writer(tempPath, ioBuffer);
+        writer.write(header);
+        if (runs.empty()) {
+            sortBuffer(rows);
+            for (const auto& row : rows) {
+                writer.write(row.text);
+            }
+            result.rows = rows.size();
+        } else {
+            if (!rows.empty() && !spill(rows, error)) {
+                return false;
+            }
+            rows = {};
+            result.runs = runs.size();
+            if (!reduceRuns(error)) {
+                return false;
+            }
+            result.rows = merge(runs, writer);
+        }
+        if (!writer.close()) {
+            error = "unable to write " + tempPath.string();
+            return false;
+        }
+        std::error_code renameError;
+        std::filesystem::rename(tempPath, output, renameError);
+        if (renameError) {
+            error = "unable to write " + output.string();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    const SortOptions& options;
+    SortResult& result;
+    const std::size_t ioBuffer;
+    std::vector<std::filesystem::path> runs;
+    std::size_t runCount = 0;
+
+    std::filesystem::path getRunPath() {
+        return options.tempDirectory / ("run-" + std::to_string(getpid()) + "-" + std::to_string(runCount++));
+    }
+
+    void sortBuffer(std::vector<Row>& rows) {
+        std::stable_sort(rows.begin(), rows.end(), [this](const Row& a, const Row& b) { return isBefore(a, b, options.order); });
+        if (options.unique) {
+            const auto end = std::unique(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.text == b.text; });
+            result.duplicates += static_cast<std::size_t>(rows.end() - end);
+            rows.erase(end, rows.end());
+        }
+    }
+
+    bool spill(std::vector<Row>& rows, std::string& error) {
+        sortBuffer(rows);
+        std::error_code directoryError;
+        std::filesystem::create_directories(options.tempDirectory, directoryError);
+        const auto path = getRunPath();
+        runs.push_back(path);
+        LineWriter writer(path, ioBuffer);
+        for (const auto& row : rows) {
+            writer.write(row.text);
+        }
+        if (!writer.close()) {
+            error = "unable to write " + path.string();
+            return false;
+        }
+        return true;
+    }
+
+    // The number of runs that can be merged at once with buffers of at least `minimumReadBuffer`.
+    std::size_t getFanIn() const {
+        return std::max<std::size_t>(options.memoryLimit / minimumReadBuffer, 3) - 1;
+    }
+
+    // Merges groups of neighbouring runs until there are few enough to merge at once.
+    // Keeping the groups in order keeps the merge stable.
+    bool reduceRuns(std::string& error) {
+        const std::size_t fanIn = getFanIn();
+        while (runs.size() > fanIn) {
+            std::vector<std::filesystem::path> merged;
+            for (std::size_t first = 0; first < runs.size(); first += fanIn) {
+                const std::vector<std::filesystem::path> group(
+                    runs.begin() + static_cast<std::ptrdiff_t>(first),
+                    runs.begin() + static_cast<std::ptrdiff_t>(std::min(first + fanIn, runs.size())));
+                const auto path = getRunPath();
+                merged.push_back(path);
+                LineWriter writer(path, ioBuffer);
+                merge(group, writer);
+                if (!writer.close()) {
+                    error = "unable to write " + path.string();
+                    runs.insert(runs.end(), merged.begin(), merged.end());
+                    return false;
+                }
+                std::error_code removeError;
+                for (const auto& run : group) {
+                    std::filesystem::remove(run, removeError);
+                }
+            }
+            runs = std::move(merged);
+        }
+        return true;
+    }
+
+    // Merges the sorted `group` of runs into `writer`, returning the number of rows written.
+    std::size_t merge(const std::vector<std::filesystem::path>& group, LineWriter& writer) {
+        const std::size_t bufferSize = std::max(options.memoryLimit / (group.size() + 1), minimumReadBuffer);
+        std::vector<RunCursor> cursors;
+        cursors.reserve(group.size());
+        for (const auto& path : group) {
+            cursors.push_back({std::make_unique<LineReader>(path, bufferSize), {}});
+        }
+
+        // Ties go to the earlier run, which makes the merge stable.
+        auto isAfter = [&](std::size_t a, std::size_t b) {
+            if (isBefore(cursors[b].row, cursors[a].row, options.order)) {
+                return true;
+            }
+            return !isBefore(cursors[a].row, cursors[b].row, options.order) && a > b;
+        };
+        std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(isAfter)> heap(isAfter);
+        for (std::size_t i = 0; i < cursors.size(); i++) {
+            if (cursors[i].advance()) {
+                heap.push(i);
+            }
+        }
+
+        std::size_t written = 0;
+        std::string previous;
+        while (!heap.empty()) {
+            const std::size_t next = heap.top();
+            heap.pop();
+            auto& row = cursors[next].row;
+            if (options.unique && written > 0 && row.text == previous) {
+                result.duplicates++;
+            } else {
+                writer.write(row.text);
+                written++;
+                if (options.unique) {
+                    previous = row.text;
+                }
+            }
+            if (cursors[next].advance()) {
+                heap.push(next);
+            }
+        }
+        return written;
+    }
+};
+
+}
+
+std::optional<SortResult> sortRows(const std::filesystem::path& input, const std::filesystem::path& output,
+                                   const SortOptions& options, std::string& error) {
+    SortResult result;
+    if (!ExternalSort(options, result).sort(input, output, error)) {
+        return std::nullopt;
+    }
+    return result;
+}
+
+bool diffRows(const std::filesystem::path& a, const std::filesystem::path& b, const SortOptions& options,
+              const std::function<void(char side, std::string_view row)>& report, std::string& error) {
+    SortOptions sortOptions = options;
+    sortOptions.order = RowOrder::ByRow;
+    sortOptions.unique = false;
+    std::error_code directoryError;
+    std::filesystem::create_directories(options.tempDirectory, directoryError);
+    const std::string prefix = "diff-" + std::to_string(getpid());
+    const auto sortedA = options.tempDirectory / (prefix + "-a");
+    const auto sortedB = options.tempDirectory / (prefix + "-b");
+    auto removeSorted = [&]() {
+        std::error_code removeError;
+        std::filesystem::remove(sortedA, removeError);
+        std::filesystem::remove(sortedB, removeError);
+    };
+    if (!sortRows(a, sortedA, sortOptions, error).has_value() || !sortRows(b, sortedB, sortOptions, error).has_value()) {
+        removeSorted();
+        return false;
+    }
+
+    const std::size_t bufferSize = std::max(options.memoryLimit / 2, minimumReadBuffer);
+    RunCursor left{std::make_unique<LineReader>(sortedA, bufferSize), {}};
+    RunCursor right{std::make_unique<LineReader>(sortedB, bufferSize), {}};
+    std::string header;
+    left.reader->next(header);
+    right.reader->next(header);
+    bool hasLeft = left.advance();
+    bool hasRight = right.advance();
+    while (hasLeft || hasRight) {
+        if (hasLeft && (!hasRight || isBefore(left.row, right.row, RowOrder::ByRow))) {
+            report('-', left.row.text);
+            hasLeft = left.advance();
+        } else if (hasRight && (!hasLeft || isBefore(right.row, left.row, RowOrder::ByRow))) {
+            report('+', right.row.text);
+            hasRight = right.advance();
+        } else {
+            hasLeft = left.advance();
+            hasRight = right.advance();
+        }
+    }
+    removeSorted();
+    return true;
+}
+
+std::optional<std::size_t> parseMemorySize(const std::string& text) {
+    std::size_t size = 0;
+    const char* end = text.data() + text.size();
+    const auto [rest, error] = std::from_chars(text.data(), end, size);
+    if (error != std::errc{} || rest == text.data()) {
+        return std::nullopt;
+    }
+    const std::string_view unit(rest, static_cast<std::size_t>(end - rest));
+    int shift = 0;
+    if (unit == "K" || unit == "k") {
+        shift = 10;
+    } else if (unit == "M" || unit == "m") {
+        shift = 20;
+    } else if (unit == "G" || unit == "g") {
+        shift = 30;
+    } else if (!unit.empty()) {
+        return std::nullopt;
+    }
+    if (size > (SIZE_MAX >> shift)) {
+        return std::nullopt;
+    }
+    return size << shift;
+}
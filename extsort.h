@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Sorting of the rows of an events file that doesn't fit in memory.
+//
+// The rows are read in order into a buffer of at most the memory limit; each
+// full buffer is sorted and spilled to a run file in the temporary directory.
+// The runs are then merged k ways, each run read through a large buffer of its
+// share of the memory limit. If there are too many runs for the buffers to stay
+// large, groups of neighbouring runs are merged into longer runs first.
+//
+// The rows are moved as the text they were read as; only the date and time are
+// parsed. Rows whose date can't be parsed are dropped and counted.
+enum class RowOrder {
+    ByDate, // by date and time only, keeping the file order of rows at the same time
+    ByRow,  // by date and time, then by the whole row, so that equal rows are next to each other
+};
+
+struct SortOptions {
+    std::size_t memoryLimit = std::size_t{256} << 20;
+    std::filesystem::path tempDirectory; // for the runs, created if missing
+    RowOrder order = RowOrder::ByDate;
+    bool unique = false; // drops repeated rows; only with `RowOrder::ByRow`
+    // Rows for which this returns false are dropped before sorting.
+    std::function<bool(std::string_view row)> keep;
+};
+
+struct SortResult {
+    std::size_t rows = 0;       // written to the output
+    std::size_t invalid = 0;    // dropped because their date didn't parse
+    std::size_t filtered = 0;   // dropped by `keep`
+    std::size_t duplicates = 0; // dropped by `unique`
+    std::size_t runs = 0;       // spilled to the temporary directory, 0 if the rows fit in memory
+};
+
+// Sorts the rows of the CSV file at `input` into `output`, which gets the same
+// header line. `output` may be the same file as `input`; it is written to a
+// temporary file that is renamed into place. Returns `std::nullopt` and sets
+// `error` if a file can't be read or written.
+std::optional<SortResult> sortRows(const std::filesystem::path& input, const std::filesystem::path& output,
+                                   const SortOptions& options, std::string& error);
+
+// Calls `report` with '-' for each row that is in `a` but not in `b`, and with
+// '+' for each row that is in `b` but not in `a`, in date order. A row that is
+// repeated is reported as many times as one file has it more often than the
+// other. Both files are sorted with `options` first, so they can be of any size.
+// Returns false and sets `error` if a file can't be read or sorted.
+bool diffRows(const std::filesystem::path& a, const std::filesystem::path& b, const SortOptions& options,
+              const std::function<void(char side, std::string_view row)>& report, std::string& error);
+
+// Parses a size like `512K`, `64M` or `2G` (or plain bytes). Returns `std::nullopt`
+// if `text` is not a size.
+std::optional<std::size_t> parseMemorySize(const std::string& text);
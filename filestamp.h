@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <sys/stat.h>
+
+// Identifies a version of a file by its size and modification time. The sidecar
+// files in ~/.days record the stamp of events.csv they were built from, which
+// is how they detect that the events file has changed underneath them.
+struct FileStamp {
+    std::uint64_t size = 0;
+    std::int64_t modified = 0; // nanoseconds since the epoch
+
+    // Returns the current stamp of `path`, or `std::nullopt` if it can't be read.
+    static std::optional<FileStamp> of(const std::filesystem::path& path) {
+        struct stat info{};
+        if (stat(path.c_str(), &info) != 0) {
+            return std::nullopt;
+        }
+        return FileStamp{
+            static_cast<std::uint64_t>(info.st_size),
+            static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec};
+    }
+
+    bool operator==(const FileStamp&) const = default;
+};
@@ -0,0 +1,584 @@
+#include "filter.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+namespace {
+
+struct Token {
+    enum class Kind { Word, String, Symbol, End };
+    Kind kind;
+    std::string text;
+    std::size_t position;
+};
+
+bool isWordCharacter(char c) {
+    return !std::isspace(static_cast<unsigned char>(c)) && std::string_view("()=,!<>~^\"'").find(c) == std::string_view::npos;
+}
+
+// Splits `expression` into words, quoted strings and operator symbols.
+std::optional<std::vector<Token>> tokenize(const std::string& expression, std::string& error) {
+    std::vector<Token> tokens;
+    std::size_t i = 0;
+    while (i < expression.size()) {
+        const char c = expression[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (c == '"' || c == '\'') {
+            const auto end = expression.find(c, i + 1);
+            if (end == std::string::npos) {
+                error = "unterminated string at position " + std::to_string(i);
+                return std::nullopt;
+            }
+            tokens.push_back({Token::Kind::String, expression.substr(i + 1, end - i - 1), i});
+            i = end + 1;
+        } else if (expression.compare(i, 2, "==") == 0 || expression.compare(i, 2, "!=") == 0 ||
+                   expression.compare(i, 2, "<=") == 0 || expression.compare(i, 2, ">=") == 0 ||
+                   expression.compare(i, 2, "^=") == 0) {
+            tokens.push_back({Token::Kind::Symbol, expression.substr(i, 2), i});
+            i += 2;
+        } else if (std::string_view("()=,<>~").find(c) != std::string_view::npos) {
+            tokens.push_back({Token::Kind::Symbol, std::string(1, c), i});
+            i++;
+        } else if (isWordCharacter(c)) {
+            const auto start = i;
+            while (i < expression.size() && isWordCharacter(expression[i])) {
+                i++;
+            }
+            tokens.push_back({Token::Kind::Word, expression.substr(start, i - start), start});
+        } else {
+            error = std::string("unexpected '") + c + "' at position " + std::to_string(i);
+            return std::nullopt;
+        }
+    }
+    tokens.push_back({Token::Kind::End, "", expression.size()});
+    return tokens;
+}
+
+}
+
+// Recursive descent parser that emits the bytecode as it goes.
+//
+//   or         := and ("or" and)*
+//   and        := not ("and" not)*
+//   not        := "not" not | primary
+//   primary    := "(" or ")" | comparison
+//   comparison := field operator value | "category" "in" "(" value ("," value)* ")"
+class FilterCompiler {
+public:
+    FilterCompiler(std::vector<Token> t, Filter& f, std::string& e) : tokens(std::move(t)), filter(f), error(e) {}
+
+    bool compile() {
+        if (!parseOr()) {
+            return false;
+        }
+        if (peek().kind != Token::Kind::End) {
+            return fail("unexpected '" + peek().text + "'");
+        }
+        return true;
+    }
+
+private:
+    using Op = Filter::Op;
+
+    const Token& peek() const { return tokens[current]; }
+    const Token& next() { return tokens[current == tokens.size() - 1 ? current : current++]; }
+
+    bool isKeyword(const char* keyword) const {
+        return peek().kind == Token::Kind::Word && peek().text == keyword;
+    }
+
+    bool isSymbol(const char* symbol) const {
+        return peek().kind == Token::Kind::Symbol && peek().text == symbol;
+    }
+
+    bool failAt(const std::string& message, std::size_t position) {
+        error = message + " at position " + std::to_string(position);
+        return false;
+    }
+
+    bool fail(const std::string& message) {
+        if (peek().kind == Token::Kind::End) {
+            error = message + " at the end of the expression";
+        } else {
+            error = message + " at position " + std::to_string(peek().position);
+        }
+        return false;
+    }
+
+    std::size_t emit(Op op, std::int32_t operand = 0) {
+        filter.code.push_back({op, operand});
+        return filter.code.size() - 1;
+    }
+
+    void patchJump(std::size_t jump) {
+        filter.code[jump].operand = static_cast<std::int32_t>(filter.code.size());
+    }
+
+    // Parses `today`, `today+N` or `today-N` into the number of days from today.
+    static std::optional<std::int32_t> getRelativeDays(const std::string& value) {
+        if (!value.starts_with("today")) {
+            return std::nullopt;
+        }
+        const std::string_view offset = std::string_view(value).substr(5);
+        if (offset.empty()) {
+            return 0;
+        }
+        if ((offset[0] != '+' && offset[0] != '-') || offset.size() < 2 || offset.size() > 7 ||
+            !std::all_of(offset.begin() + 1, offset.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+            return std::nullopt;
+        }
+        const std::int32_t days = std::stoi(std::string(offset.substr(1)));
+        return offset[0] == '-' ? -days : days;
+    }
+
+    std::int32_t addString(const std::string& s) {
+        filter.strings.push_back(s);
+        return static_cast<std::int32_t>(filter.strings.size() - 1);
+    }
+
+    bool parseOr() {
+        if (!parseAnd()) {
+            return false;
+        }
+        // All the jumps go straight to the end of the chain.
+        std::vector<std::size_t> jumps;
+        while (isKeyword("or")) {
+            next();
+            jumps.push_back(emit(Op::JumpIfTrue));
+            if (!parseAnd()) {
+                return false;
+            }
+        }
+        for (auto jump : jumps) {
+            patchJump(jump);
+        }
+        return true;
+    }
+
+    bool parseAnd() {
+        if (!parseNot()) {
+            return false;
+        }
+        // All the jumps go straight to the end of the chain.
+        std::vector<std::size_t> jumps;
+        while (isKeyword("and")) {
+            next();
+            jumps.push_back(emit(Op::JumpIfFalse));
+            if (!parseNot()) {
+                return false;
+            }
+        }
+        for (auto jump : jumps) {
+            patchJump(jump);
+        }
+        return true;
+    }
+
+    bool parseNot() {
+        if (isKeyword("not")) {
+            next();
+            if (!parseNot()) {
+                return false;
+            }
+            emit(Op::Not);
+            return true;
+        }
+        return parsePrimary();
+    }
+
+    bool parsePrimary() {
+        if (isSymbol("(")) {
+            next();
+            if (!parseOr()) {
+                return false;
+            }
+            if (!isSymbol(")")) {
+                return fail("expected ')'");
+            }
+            next();
+            return true;
+        }
+        return parseComparison();
+    }
+
+    bool parseValue(std::string& value) {
+        if (peek().kind != Token::Kind::Word && peek().kind != Token::Kind::String) {
+            return fail("expected a value");
+        }
+        value = next().text;
+        return true;
+    }
+
+    bool parseComparison() {
+        if (peek().kind != Token::Kind::Word) {
+            return fail("expected date, category or description");
+        }
+        const std::string field = peek().text;
+        if (field != "date" && field != "category" && field != "description") {
+            return fail("unknown field '" + field + "'");
+        }
+        next();
+
+        if (field == "category" && isKeyword("in")) {
+            next();
+            return parseSet();
+        }
+        if (peek().kind != Token::Kind::Symbol || isSymbol("(") || isSymbol(")") || isSymbol(",")) {
+            return fail("expected a comparison operator");
+        }
+        const std::size_t opPosition = peek().position;
+        const std::string op = next().text;
+        const std::size_t valuePosition = peek().position;
+        std::string value;
+        if (!parseValue(value)) {
+            return false;
+        }
+
+        if (field == "date") {
+            if (const auto dateTime = getDateTimeFromString(value); dateTime.has_value() && dateTime->time.has_value()) {
+                // The operands are 32 bits, which hold the minutes up to the year 6053.
+                const std::int64_t minute = getMinuteNumber(dateTime->date, dateTime->time);
+                if (minute > INT32_MAX) {
+                    return failAt("expected a date and time before the year 6054", valuePosition);
+                }
+                const auto operand = static_cast<std::int32_t>(minute);
+                if (op == "=" || op == "==") return emit(Op::TimeEq, operand), true;
+                if (op == "!=") return emit(Op::TimeNe, operand), true;
+                if (op == "<") return emit(Op::TimeLt, operand), true;
+                if (op == "<=") return emit(Op::TimeLe, operand), true;
+                if (op == ">") return emit(Op::TimeGt, operand), true;
+                if (op == ">=") return emit(Op::TimeGe, operand), true;
+                return failAt("operator '" + op + "' can't be used with " + field, opPosition);
+            }
+            std::int32_t day = 0;
+            const auto relative = getRelativeDays(value);
+            if (relative.has_value()) {
+                filter.relativeDates.push_back({static_cast<std::uint32_t>(filter.code.size()), relative.value()});
+                day = relative.value(); // an offset until the filter is bound
+            } else if (const auto date = getDateFromString(value); date.has_value()) {
+                day = getDayNumberFromDate(date.value());
+            } else {
+                return failAt("expected a date in YYYY-MM-DD or YYYY-MM-DDTHH:MM format or today[+-N]", valuePosition);
+            }
+            if (op == "=" || op == "==") return emit(Op::DateEq, day), true;
+            if (op == "!=") return emit(Op::DateNe, day), true;
+            if (op == "<") return emit(Op::DateLt, day), true;
+            if (op == "<=") return emit(Op::DateLe, day), true;
+            if (op == ">") return emit(Op::DateGt, day), true;
+            if (op == ">=") return emit(Op::DateGe, day), true;
+            if (relative.has_value()) {
+                filter.relativeDates.pop_back();
+            }
+        } else if (field == "category") {
+            if (op == "=" || op == "==") return emit(Op::CategoryEq, addString(value)), true;
+            if (op == "!=") return emit(Op::CategoryNe, addString(value)), true;
+        } else {
+            if (op == "=" || op == "==") return emit(Op::DescriptionEq, addString(value)), true;
+            if (op == "!=") return emit(Op::DescriptionNe, addString(value)), true;
+            if (op == "^=") return emit(Op::DescriptionPrefix, addString(value)), true;
+            if (op == "~") {
+                try {
+                    filter.regexes.emplace_back(value, std::regex::ECMAScript | std::regex::optimize);
+                } catch (const std::regex_error& ex) {
+                    return failAt("invalid regular expression (" + std::string(ex.what()) + ")", valuePosition);
+                }
+                filter.patterns.push_back(value);
+                return emit(Op::DescriptionMatch, static_cast<std::int32_t>(filter.regexes.size() - 1)), true;
+            }
+        }
+        return failAt("operator '" + op + "' can't be used with " + field, opPosition);
+    }
+
+    bool parseSet() {
+        if (!isSymbol("(")) {
+            return fail("expected '('");
+        }
+        next();
+        std::vector<std::string> set;
+        while (true) {
+            std::string value;
+            if (!parseValue(value)) {
+                return false;
+            }
+            set.push_back(value);
+            if (isSymbol(")")) {
+                next();
+                break;
+            }
+            if (!isSymbol(",")) {
+                return fail("expected ',' or ')'");
+            }
+            next();
+        }
+        std::sort(set.begin(), set.end());
+        set.erase(std::unique(set.begin(), set.end()), set.end());
+        filter.sets.push_back(std::move(set));
+        emit(Op::CategoryIn, static_cast<std::int32_t>(filter.sets.size() - 1));
+        return true;
+    }
+
+    std::vector<Token> tokens;
+    std::size_t current = 0;
+    Filter& filter;
+    std::string& error;
+};
+
+std::optional<Filter> Filter::compile(const std::string& expression, std::string& error) {
+    auto tokens = tokenize(expression, error);
+    if (!tokens.has_value()) {
+        return std::nullopt;
+    }
+    Filter filter;
+    if (!FilterCompiler(std::move(tokens.value()), filter, error).compile()) {
+        return std::nullopt;
+    }
+    if (filter.isRelative()) {
+        filter.bind(getDayNumberFromDate(std::chrono::year_month_day{getToday()}));
+    }
+    return filter;
+}
+
+void Filter::bind(std::int32_t today) {
+    for (const auto& date : relativeDates) {
+        code[date.instruction].operand = today + date.days;
+    }
+}
+
+std::optional<Filter> Filter::compileMatch(const std::string& pattern, std::string& error) {
+    Filter filter;
+    try {
+        filter.regexes.emplace_back(pattern, std::regex::ECMAScript | std::regex::optimize);
+    } catch (const std::regex_error& ex) {
+        error = "invalid regular expression (" + std::string(ex.what()) + ")";
+        return std::nullopt;
+    }
+    filter.patterns.push_back(pattern);
+    filter.code.push_back({Op::DescriptionMatch, 0});
+    return filter;
+}
+
+bool Filter::matches(std::int32_t day, std::int64_t minute, std::string_view category, std::string_view description) const {
+    bool result = false;
+    const Instruction* instructions = code.data();
+    const std::size_t count = code.size();
+    for (std::size_t pc = 0; pc < count;) {
+        const Instruction& instruction = instructions[pc++];
+        switch (instruction.op) {
+        case Op::DateEq: result = day == instruction.operand; break;
+        case Op::DateNe: result = day != instruction.operand; break;
+        case Op::DateLt: result = day < instruction.operand; break;
+        case Op::DateLe: result = day <= instruction.operand; break;
+        case Op::DateGt: result = day > instruction.operand; break;
+        case Op::DateGe: result = day >= instruction.operand; break;
+        case Op::TimeEq: result = minute == instruction.operand; break;
+        case Op::TimeNe: result = minute != instruction.operand; break;
+        case Op::TimeLt: result = minute < instruction.operand; break;
+        case Op::TimeLe: result = minute <= instruction.operand; break;
+        case Op::TimeGt: result = minute > instruction.operand; break;
+        case Op::TimeGe: result = minute >= instruction.operand; break;
+        case Op::CategoryEq: result = category == strings[instruction.operand]; break;
+        case Op::CategoryNe: result = category != strings[instruction.operand]; break;
+        case Op::CategoryIn: {
+            const auto& set = sets[instruction.operand];
+            result = std::binary_search(set.begin(), set.end(), category);
+            break;
+        }
+        case Op::DescriptionEq: result = description == strings[instruction.operand]; break;
+        case Op::DescriptionNe: result = description != strings[instruction.operand]; break;
+        case Op::DescriptionPrefix: result = description.starts_with(strings[instruction.operand]); break;
+        case Op::DescriptionMatch:
+            result = std::regex_search(description.begin(), description.end(), regexes[instruction.operand]);
+            break;
+        case Op::Not: result = !result; break;
+        case Op::JumpIfFalse:
+            if (!result) {
+                pc = instruction.operand;
+            }
+            break;
+        case Op::JumpIfTrue:
+            if (result) {
+                pc = instruction.operand;
+            }
+            break;
+        }
+    }
+    return result;
+}
+
+std::string Filter::disassemble() const {
+    static const char* names[] = {
+        "date ==", "date !=", "date <", "date <=", "date >", "date >=",
+        "category ==", "category !=", "category in",
+        "description ==", "description !=", "description ^=", "description ~",
+        "not", "jump if false", "jump if true",
+        "time ==", "time !=", "time <", "time <=", "time >", "time >=",
+    };
+
+    std::ostringstream out;
+    for (std::size_t pc = 0; pc < code.size(); pc++) {
+        const auto& instruction = code[pc];
+        out << pc << ": " << names[static_cast<int>(instruction.op)];
+        switch (instruction.op) {
+        case Op::DateEq: case Op::DateNe: case Op::DateLt: case Op::DateLe: case Op::DateGt: case Op::DateGe: {
+            out << " " << getStringFromDate(std::chrono::year_month_day{std::chrono::sys_days{std::chrono::days{instruction.operand}}});
+            const auto relative = std::find_if(relativeDates.begin(), relativeDates.end(),
+                                               [&](const RelativeDate& date) { return date.instruction == pc; });
+            if (relative != relativeDates.end()) {
+                out << " (today" << (relative->days < 0 ? "" : "+") << relative->days << ")";
+            }
+            break;
+        }
+        case Op::TimeEq: case Op::TimeNe: case Op::TimeLt: case Op::TimeLe: case Op::TimeGt: case Op::TimeGe: {
+            const auto minute = std::chrono::sys_time<std::chrono::minutes>{std::chrono::minutes{instruction.operand}};
+            const auto day = std::chrono::floor<std::chrono::days>(minute);
+            out << " " << getStringFromDateTime(std::chrono::year_month_day{day}, minute - day);
+            break;
+        }
+        case Op::CategoryEq: case Op::CategoryNe: case Op::DescriptionEq: case Op::DescriptionNe: case Op::DescriptionPrefix:
+            out << " \"" << strings[instruction.operand] << "\"";
+            break;
+        case Op::CategoryIn:
+            for (const auto& member : sets[instruction.operand]) {
+                out << " \"" << member << "\"";
+            }
+            break;
+        case Op::DescriptionMatch:
+            out << " /" << patterns[instruction.operand] << "/";
+            break;
+        case Op::JumpIfFalse: case Op::JumpIfTrue:
+            out << " " << instruction.operand;
+            break;
+        case Op::Not:
+            break;
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+void Filter::serialize(std::string& buffer) const {
+    WireWriter out(buffer);
+    out.u32(static_cast<std::uint32_t>(code.size()));
+    for (const auto& instruction : code) {
+        out.u8(static_cast<std::uint8_t>(instruction.op));
+        out.i32(instruction.operand);
+    }
+    out.u32(static_cast<std::uint32_t>(strings.size()));
+    for (const auto& string : strings) {
+        out.string(string);
+    }
+    out.u32(static_cast<std::uint32_t>(sets.size()));
+    for (const auto& set : sets) {
+        out.u32(static_cast<std::uint32_t>(set.size()));
+        for (const auto& member : set) {
+            out.string(member);
+        }
+    }
+    out.u32(static_cast<std::uint32_t>(patterns.size()));
+    for (const auto& pattern : patterns) {
+        out.string(pattern);
+    }
+    out.u32(static_cast<std::uint32_t>(relativeDates.size()));
+    for (const auto& date : relativeDates) {
+        out.u32(date.instruction);
+        out.i32(date.days);
+    }
+}
+
+std::optional<Filter> Filter::deserialize(std::string_view data, std::string& error) {
+    WireReader in(data);
+    Filter filter;
+    // Every count is checked against the bytes left, so a corrupt count can't
+    // make us allocate: each entry takes at least `entryBytes`.
+    bool counted = true;
+    auto readCount = [&](std::size_t entryBytes) {
+        const std::uint32_t count = in.u32();
+        if (count > in.remaining() / entryBytes) {
+            counted = false;
+            return std::uint32_t{0};
+        }
+        return count;
+    };
+
+    for (std::uint32_t i = 0, count = readCount(5); i < count; i++) {
+        const std::uint8_t op = in.u8();
+        const std::int32_t operand = in.i32();
+        if (op > static_cast<std::uint8_t>(Op::TimeGe)) {
+            error = "unknown filter instruction";
+            return std::nullopt;
+        }
+        filter.code.push_back({static_cast<Op>(op), operand});
+    }
+    for (std::uint32_t i = 0, count = readCount(4); i < count; i++) {
+        filter.strings.emplace_back(in.string());
+    }
+    for (std::uint32_t i = 0, count = readCount(4); i < count; i++) {
+        std::vector<std::string> set;
+        for (std::uint32_t j = 0, members = readCount(4); j < members; j++) {
+            set.emplace_back(in.string());
+        }
+        std::sort(set.begin(), set.end());
+        filter.sets.push_back(std::move(set));
+    }
+    for (std::uint32_t i = 0, count = readCount(4); i < count; i++) {
+        filter.patterns.emplace_back(in.string());
+    }
+    for (std::uint32_t i = 0, count = readCount(8); i < count; i++) {
+        const std::uint32_t instruction = in.u32();
+        const std::int32_t days = in.i32();
+        if (instruction >= filter.code.size() || filter.code[instruction].op > Op::DateGe) {
+            error = "relative date on an instruction that isn't a date comparison";
+            return std::nullopt;
+        }
+        filter.relativeDates.push_back({instruction, days});
+    }
+    if (!counted || !in.isValid() || in.remaining() != 0) {
+        error = "truncated filter";
+        return std::nullopt;
+    }
+
+    for (const auto& pattern : filter.patterns) {
+        try {
+            filter.regexes.emplace_back(pattern, std::regex::ECMAScript | std::regex::optimize);
+        } catch (const std::regex_error& ex) {
+            error = "invalid regular expression (" + std::string(ex.what()) + ")";
+            return std::nullopt;
+        }
+    }
+
+    auto isIndexOf = [](std::int32_t operand, std::size_t size) {
+        return operand >= 0 && static_cast<std::size_t>(operand) < size;
+    };
+    for (std::size_t pc = 0; pc < filter.code.size(); pc++) {
+        const auto& instruction = filter.code[pc];
+        bool valid = true;
+        switch (instruction.op) {
+        case Op::DateEq: case Op::DateNe: case Op::DateLt: case Op::DateLe: case Op::DateGt: case Op::DateGe:
+        case Op::TimeEq: case Op::TimeNe: case Op::TimeLt: case Op::TimeLe: case Op::TimeGt: case Op::TimeGe:
+        case Op::Not:
+            break;
+        case Op::CategoryEq: case Op::CategoryNe: case Op::DescriptionEq: case Op::DescriptionNe: case Op::DescriptionPrefix:
+            valid = isIndexOf(instruction.operand, filter.strings.size());
+            break;
+        case Op::CategoryIn:
+            valid = isIndexOf(instruction.operand, filter.sets.size());
+            break;
+        case Op::DescriptionMatch:
+            valid = isIndexOf(instruction.operand, filter.regexes.size());
+            break;
+        case Op::JumpIfFalse: case Op::JumpIfTrue:
+            // The compiler only jumps forward, and a jump backward could loop
+            // forever where no deadline is checked.
+            valid = isIndexOf(instruction.operand, filter.code.size() + 1) && static_cast<std::size_t>(instruction.operand) > pc;
+            break;
+        }
+        if (!valid) {
+            error = "filter operand out of range";
+            return std::nullopt;
+        }
+    }
+    return filter;
+}
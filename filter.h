@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "event.h"
+
+// A filter expression compiled to bytecode, as given to `--where`:
+//
+//   date >= 2026-01-01 and category in (work, home) and description ~ "deploy"
+//
+// Fields are `date`, `category` and `description`. Dates compare with
+// = != < <= > >=, strings with = and !=; `category in (a, b)` tests set
+// membership, `description ^= "text"` tests for a prefix and
+// `description ~ "regex"` searches for a regular expression. Conditions combine
+// with `and`, `or`, `not` and parentheses.
+//
+// A date can be given with a time of day, as `2026-10-18T09:30`; it is then
+// compared with the date and time of the events, and an event without a time
+// counts as the start of its day.
+//
+// A date can also be given relative to the current day, as `today`, `today-7`
+// or `today+30`. Compiling resolves it against the current day; `bind` resolves
+// it again for another day, so that a compiled filter can be kept and reused.
+//
+// The program runs on a single boolean accumulator: every comparison loads
+// its result into it, `not` flips it, and `and`/`or` are conditional jumps over
+// the right-hand side, so evaluation short-circuits without a stack.
+class Filter {
+public:
+    // Compiles `expression`. Returns `std::nullopt` and sets `error` if the
+    // expression is not valid.
+    static std::optional<Filter> compile(const std::string& expression, std::string& error);
+
+    // Compiles a filter that searches descriptions for the regular expression
+    // `pattern`, the same as `description ~ "pattern"` without the quoting.
+    static std::optional<Filter> compileMatch(const std::string& pattern, std::string& error);
+
+    // `day` is the day number and `minute` the minute number of the event (see event.h).
+    bool matches(std::int32_t day, std::int64_t minute, std::string_view category, std::string_view description) const;
+
+    bool matches(const Event& event) const {
+        return matches(event.getDayNumber(), getMinuteNumber(event), event.getCategory(), event.getDescription());
+    }
+
+    // Returns a readable listing of the bytecode.
+    std::string disassemble() const;
+
+    // Resolves the relative dates against `today`, a day number.
+    void bind(std::int32_t today);
+
+    // Returns true if the filter has relative dates, so that it depends on the day.
+    bool isRelative() const { return !relativeDates.empty(); }
+
+    // Appends the compiled program to `buffer`, so that it can be sent to the
+    // daemon without the expression being parsed again there.
+    void serialize(std::string& buffer) const;
+
+    // Reads a program written by `serialize`. The data comes from a socket, so
+    // every operand is checked before the program can run. Returns
+    // `std::nullopt` and sets `error` if it is not a valid program.
+    static std::optional<Filter> deserialize(std::string_view data, std::string& error);
+
+    enum class Op : std::uint8_t {
+        DateEq, DateNe, DateLt, DateLe, DateGt, DateGe, // operand: day number
+        CategoryEq, CategoryNe,                         // operand: string constant
+        CategoryIn,                                     // operand: set constant
+        DescriptionEq, DescriptionNe,                   // operand: string constant
+        DescriptionPrefix,                              // operand: string constant
+        DescriptionMatch,                               // operand: regex constant
+        Not,
+        JumpIfFalse, JumpIfTrue,                        // operand: target instruction
+        TimeEq, TimeNe, TimeLt, TimeLe, TimeGt, TimeGe, // operand: minute number
+    };
+
+    struct Instruction {
+        Op op;
+        std::int32_t operand;
+    };
+
+    const std::vector<Instruction>& getCode() const { return code; }
+    const std::vector<std::string>& getStrings() const { return strings; }
+    const std::vector<std::vector<std::string>>& getSets() const { return sets; }
+
+private:
+    friend class FilterCompiler;
+
+    std::vector<Instruction> code;
+    std::vector<std::string> strings;
+    std::vector<std::vector<std::string>> sets; // each sorted, for binary search
+    std::vector<std::regex> regexes;
+    std::vector<std::string> patterns;          // source of each regex, for disassembly
+
+    struct RelativeDate {
+        std::uint32_t instruction;
+        std::int32_t days; // from today
+    };
+    std::vector<RelativeDate> relativeDates;
+};
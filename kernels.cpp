@@ -0,0 +1,178 @@
+#include "kernels.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+EventColumns EventColumns::of(const std::vector<Event>& events) {
+    EventColumns columns;
+    columns.days.reserve(events.size());
+    columns.minutes.reserve(events.size());
+    columns.categories.reserve(events.size());
+    columns.descriptions.reserve(events.size());
+    columns.categoryIds.reserve(events.size());
+
+    // The rows are numbered by first occurrence while the distinct categories are
+    // collected, and renumbered once the perfect hash has given them their ids.
+    std::unordered_map<std::string_view, std::uint32_t> firstIds;
+    std::vector<std::string_view> distinct;
+    for (const auto& event : events) {
+        columns.days.push_back(event.getDayNumber());
+        columns.minutes.push_back(getMinuteNumber(event));
+        columns.categories.push_back(event.getCategory());
+        columns.descriptions.push_back(event.getDescription());
+        const auto [found, added] = firstIds.try_emplace(columns.categories.back(), static_cast<std::uint32_t>(distinct.size()));
+        if (added) {
+            distinct.push_back(columns.categories.back());
+        }
+        columns.categoryIds.push_back(found->second);
+    }
+    columns.categoryDictionary = PerfectHash::build(distinct);
+    std::vector<std::uint32_t> ids(distinct.size());
+    for (std::size_t i = 0; i < distinct.size(); i++) {
+        ids[i] = columns.categoryDictionary.find(distinct[i]).value();
+    }
+    for (auto& id : columns.categoryIds) {
+        id = ids[id];
+    }
+    return columns;
+}
+
+std::optional<ScanShape> getScanShape(const Filter& filter) {
+    using Op = Filter::Op;
+    const auto& code = filter.getCode();
+    if (code.empty()) {
+        return std::nullopt;
+    }
+
+    // A conjunction compiles to comparisons separated by jumps to the end.
+    ScanShape shape;
+    for (std::size_t pc = 0; pc < code.size(); pc++) {
+        const auto& instruction = code[pc];
+        if (pc % 2 == 1) {
+            if (instruction.op != Op::JumpIfFalse || instruction.operand != static_cast<std::int32_t>(code.size())) {
+                return std::nullopt;
+            }
+            continue;
+        }
+
+        const std::int32_t operand = instruction.operand;
+        auto raiseLow = [&](std::int32_t day) { shape.low = std::max(shape.low.value_or(INT32_MIN), day); };
+        auto lowerHigh = [&](std::int32_t day) { shape.high = std::min(shape.high.value_or(INT32_MAX), day); };
+        auto restrictCategories = [&](std::vector<std::string> set) {
+            if (shape.categories.has_value()) {
+                std::erase_if(set, [&](const std::string& c) { return !kernels::contains(shape.categories.value(), c); });
+            }
+            shape.categories = std::move(set);
+        };
+
+        switch (instruction.op) {
+        case Op::DateEq: raiseLow(operand); lowerHigh(operand); break;
+        case Op::DateLt: lowerHigh(operand - 1); break;
+        case Op::DateLe: lowerHigh(operand); break;
+        case Op::DateGt: raiseLow(operand + 1); break;
+        case Op::DateGe: raiseLow(operand); break;
+        case Op::CategoryEq: restrictCategories({filter.getStrings()[operand]}); break;
+        case Op::CategoryIn: restrictCategories(filter.getSets()[operand]); break;
+        case Op::DescriptionPrefix:
+            if (shape.prefix.has_value()) {
+                return std::nullopt; // two prefixes: leave it to the bytecode
+            }
+            shape.prefix = filter.getStrings()[operand];
+            break;
+        default:
+            return std::nullopt;
+        }
+    }
+    return shape;
+}
+
+void scanShape(const EventColumns& columns, const ScanShape& shape, std::size_t first, std::size_t last, std::vector<std::uint32_t>& selection) {
+    using Kernel = void (*)(const EventColumns&, const ScanShape&, std::size_t, std::size_t, std::vector<std::uint32_t>&);
+    static constexpr Kernel kernelTable[8] = {
+        kernels::scanKernel<false, false, false>,
+        kernels::scanKernel<false, false, true>,
+        kernels::scanKernel<false, true, false>,
+        kernels::scanKernel<false, true, true>,
+        kernels::scanKernel<true, false, false>,
+        kernels::scanKernel<true, false, true>,
+        kernels::scanKernel<true, true, false>,
+        kernels::scanKernel<true, true, true>,
+    };
+
+    const bool hasDate = shape.low.has_value() || shape.high.has_value();
+    if (hasDate && shape.low.value_or(INT32_MIN) > shape.high.value_or(INT32_MAX)) {
+        return; // an empty date range matches nothing
+    }
+    const int index = (hasDate ? 4 : 0) | (shape.categories.has_value() ? 2 : 0) | (shape.prefix.has_value() ? 1 : 0);
+    kernelTable[index](columns, shape, first, last, selection);
+}
+
+void scanGeneric(const EventColumns& columns, const Filter& filter, std::size_t first, std::size_t last, std::vector<std::uint32_t>& selection) {
+    for (std::size_t row = first; row < last; row++) {
+        if (filter.matches(columns.days[row], columns.minutes[row], columns.categories[row], columns.descriptions[row])) {
+            selection.push_back(static_cast<std::uint32_t>(row));
+        }
+    }
+}
+
+std::vector<std::uint32_t> scanGeneric(const EventColumns& columns, const Filter& filter) {
+    std::vector<std::uint32_t> selection;
+    scanGeneric(columns, filter, 0, columns.size(), selection);
+    return selection;
+}
+
+namespace {
+
+std::optional<std::vector<std::uint32_t>> scanPlanned(const EventColumns& columns, const Filter& filter, const std::optional<ScanShape>& shape,
+                                                      const QueryControl& control) {
+    std::vector<std::uint32_t> selection;
+    for (std::size_t first = 0; first < columns.size(); first += morselRows) {
+        if (control.isStopped()) {
+            return std::nullopt;
+        }
+        const std::size_t last = std::min(first + morselRows, columns.size());
+        if (shape.has_value()) {
+            scanShape(columns, shape.value(), first, last, selection);
+        } else {
+            scanGeneric(columns, filter, first, last, selection);
+        }
+    }
+    return selection;
+}
+
+}
+
+std::optional<std::vector<std::uint32_t>> scan(const EventColumns& columns, const Filter& filter, const QueryControl& control) {
+    return scanPlanned(columns, filter, getScanShape(filter), control);
+}
+
+std::optional<std::vector<std::uint32_t>> scan(const EventColumns& columns, const QueryPlan& plan, const QueryControl& control) {
+    return scanPlanned(columns, plan.filter, plan.shape, control);
+}
+
+std::optional<std::vector<std::vector<std::uint32_t>>> scanShared(const EventColumns& columns, const std::vector<const QueryPlan*>& plans,
+                                                                  const QueryControl& control) {
+    // The blocks are smaller than the morsels of a single scan, so that the
+    // columns of one stay in the L2 cache while every plan goes over it. Their
+    // date range is found once for all the plans, and a plan whose dates are all
+    // outside of it skips the block; with the events in date order, that is most
+    // blocks for most date-bounded plans.
+    constexpr std::size_t blockRows = 4096;
+    std::vector<std::vector<std::uint32_t>> selections(plans.size());
+    for (std::size_t first = 0; first < columns.size(); first += blockRows) {
+        if (control.isStopped()) {
+            return std::nullopt;
+        }
+        const std::size_t last = std::min(first + blockRows, columns.size());
+        const auto [lowest, highest] = std::minmax_element(columns.days.begin() + first, columns.days.begin() + last);
+        for (std::size_t i = 0; i < plans.size(); i++) {
+            const auto& shape = plans[i]->shape;
+            if (!shape.has_value()) {
+                scanGeneric(columns, plans[i]->filter, first, last, selections[i]);
+            } else if (shape->low.value_or(INT32_MIN) <= *highest && shape->high.value_or(INT32_MAX) >= *lowest) {
+                scanShape(columns, shape.value(), first, last, selections[i]);
+            }
+        }
+    }
+    return selections;
+}
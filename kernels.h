@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "event.h"
+#include "filter.h"
+#include "perfecthash.h"
+#include "querycontrol.h"
+
+// The events laid out column by column for scanning. The string columns are
+// views into the events, which have to outlive the columns. The categories are
+// also numbered through a perfect hash over the distinct ones, so that a category
+// set is resolved to ids once and the rows are tested by id.
+struct EventColumns {
+    std::vector<std::int32_t> days;
+    std::vector<std::int64_t> minutes; // for comparisons with a time of day
+    std::vector<std::string_view> categories;
+    std::vector<std::string_view> descriptions;
+    std::vector<std::uint32_t> categoryIds; // ids in `categoryDictionary`
+    PerfectHash categoryDictionary;
+
+    static EventColumns of(const std::vector<Event>& events);
+
+    std::size_t size() const { return days.size(); }
+};
+
+// The common filter shapes that have a specialized scan kernel: a conjunction
+// of an optional date range, an optional category set and an optional
+// description prefix.
+struct ScanShape {
+    std::optional<std::int32_t> low;                  // first day included
+    std::optional<std::int32_t> high;                 // last day included
+    std::optional<std::vector<std::string>> categories;
+    std::optional<std::string> prefix;
+};
+
+// Recognizes the shape of `filter`, or returns `std::nullopt` if it is not one
+// of the shapes with a kernel (for example because it uses `or`, `not` or a
+// regular expression).
+std::optional<ScanShape> getScanShape(const Filter& filter);
+
+// A filter with the scan shape chosen for it, so that a query run many times is
+// planned once.
+struct QueryPlan {
+    Filter filter;
+    std::optional<ScanShape> shape;
+
+    explicit QueryPlan(Filter f) : filter(std::move(f)), shape(getScanShape(filter)) {}
+};
+
+// Rows are scanned in blocks ("morsels") of this many rows. Cancellation and
+// deadlines are checked between blocks.
+constexpr std::size_t morselRows = 16384;
+
+// Returns the positions of the rows that match `filter`. Uses a specialized
+// kernel for the shape of the filter if there is one, and runs the bytecode
+// for each row otherwise. Returns `std::nullopt` if `control` stops the scan.
+std::optional<std::vector<std::uint32_t>> scan(const EventColumns& columns, const Filter& filter,
+                                               const QueryControl& control = QueryControl());
+
+// Returns the positions of the rows that match the filter of `plan`, like `scan`
+// above without planning it again.
+std::optional<std::vector<std::uint32_t>> scan(const EventColumns& columns, const QueryPlan& plan,
+                                               const QueryControl& control = QueryControl());
+
+// Returns the positions of the rows that match each of `plans`, in one pass over
+// the columns: every block of rows is scanned for all of the plans while it is
+// in the cache, instead of each plan reading all of the columns. Returns
+// `std::nullopt` if `control` stops the scan.
+std::optional<std::vector<std::vector<std::uint32_t>>> scanShared(const EventColumns& columns, const std::vector<const QueryPlan*>& plans,
+                                                                  const QueryControl& control = QueryControl());
+
+// Returns the positions of the rows that match `filter` by running its bytecode
+// for each row.
+std::vector<std::uint32_t> scanGeneric(const EventColumns& columns, const Filter& filter);
+
+// Appends the positions of the rows in [`first`, `last`) that match `filter`,
+// running its bytecode for each row.
+void scanGeneric(const EventColumns& columns, const Filter& filter, std::size_t first, std::size_t last, std::vector<std::uint32_t>& selection);
+
+// Returns the positions of the rows in [`first`, `last`) that match `shape`,
+// with the kernel instantiated for its combination of conditions. Each kernel
+// is a plain loop with the conditions it doesn't need compiled out, so there
+// is no per-row dispatch.
+void scanShape(const EventColumns& columns, const ScanShape& shape, std::size_t first, std::size_t last, std::vector<std::uint32_t>& selection);
+
+namespace kernels {
+
+// Category sets are short in practice, so a linear search beats hashing.
+inline bool contains(const std::vector<std::string>& set, std::string_view value) {
+    for (const auto& member : set) {
+        if (member == value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <bool HasDate, bool HasCategory, bool HasPrefix>
+void scanKernel(const EventColumns& columns, const ScanShape& shape, std::size_t first, std::size_t last,
+                std::vector<std::uint32_t>& selection) {
+    const std::int32_t low = shape.low.value_or(INT32_MIN);
+    const std::int32_t high = shape.high.value_or(INT32_MAX);
+    // The categories of the set that occur at all, flagged by id.
+    std::vector<std::uint8_t> wanted;
+    if constexpr (HasCategory) {
+        wanted.assign(columns.categoryDictionary.size(), 0);
+        for (const auto& category : shape.categories.value()) {
+            if (const auto id = columns.categoryDictionary.find(category)) {
+                wanted[id.value()] = 1;
+            }
+        }
+    }
+    const std::string_view prefix = HasPrefix ? std::string_view(shape.prefix.value()) : std::string_view();
+
+    const std::int32_t* days = columns.days.data();
+    const std::uint32_t* categoryIds = columns.categoryIds.data();
+    const std::string_view* descriptionColumn = columns.descriptions.data();
+    for (std::size_t row = first; row < last; row++) {
+        if constexpr (HasDate) {
+            // With unsigned wraparound, one comparison tests both bounds.
+            if (static_cast<std::uint32_t>(days[row]) - static_cast<std::uint32_t>(low) >
+                static_cast<std::uint32_t>(high) - static_cast<std::uint32_t>(low)) {
+                continue;
+            }
+        }
+        if constexpr (HasCategory) {
+            if (!wanted[categoryIds[row]]) {
+                continue;
+            }
+        }
+        if constexpr (HasPrefix) {
+            if (!descriptionColumn[row].starts_with(prefix)) {
+                continue;
+            }
+        }
+        selection.push_back(static_cast<std::uint32_t>(row));
+    }
+}
+
+}
@@ -0,0 +1,271 @@
+// Load generator for the days daemon (`days serve`). Opens a number of
+// connections and sends a mix of requests at a fixed total rate, then reports
+// the throughput and the latency percentiles.
+//
+// Build with `make days-loadgen` and run, for example:
+//
+//   ./days-loadgen --connections 8 --rate 2000 --duration 10 --mix list=70,add=10,delete=10,stats=10
+//
+// The added events are dated 2030-01-01 with a `loadgen-<connection>` category,
+// and each connection deletes what is left of them when it is done.
+//
+// Latencies are measured from when each request was due to be sent, not from
+// when it actually was: if the daemon stalls, the requests that should have
+// gone out during the stall count their waiting time too. Measuring from the
+// actual send ("coordinated omission") hides exactly the stalls a load test is
+// meant to find.
+
+#include <iostream>  // for standard I/O streams
+#include <iomanip>   // for stream control
+#include <string>    // for std::string class
+#include <vector>    // for std::vector class
+#include <chrono>    // for scheduling and timing
+#include <random>    // for picking the requests
+#include <thread>    // for one thread per connection
+#include <atomic>    // for counting failures
+#include <algorithm> // for std::sort
+#include <cstdlib>   // for std::getenv
+#include <sstream>   // for parsing the mix
+#include <unistd.h>  // for close
+
+#include "event.h"    // for the dates of added events
+#include "filter.h"   // for compiling the list query
+#include "protocol.h" // for the daemon's messages
+#include "server.h"   // for the framing and connecting
+
+struct Options
+{
+    std::string socketPath;
+    int connections = 4;
+    double rate = 1000;   // requests per second over all connections
+    double duration = 10; // seconds
+    std::string where = "date >= 2020-01-01 and category in (work, home)";
+    // Relative weights of list, add, delete and stats requests.
+    int list = 70;
+    int add = 10;
+    int remove = 10;
+    int stats = 10;
+};
+
+// The results of one connection.
+struct ConnectionResult
+{
+    std::vector<double> latencies; // microseconds, from the intended send time
+    std::size_t failures = 0;
+    std::size_t errors = 0; // responses with an error status
+    std::size_t unsent = 0; // due before the end, but the daemon was too far behind to send them
+};
+
+bool parseMix(const std::string &mix, Options &options)
+{
+    std::stringstream stream(mix);
+    std::string part;
+    while (std::getline(stream, part, ','))
+    {
+        const auto equals = part.find('=');
+        if (equals == std::string::npos)
+            return false;
+        const std::string name = part.substr(0, equals);
+        const int weight = std::stoi(part.substr(equals + 1));
+        if (name == "list")
+            options.list = weight;
+        else if (name == "add")
+            options.add = weight;
+        else if (name == "delete")
+            options.remove = weight;
+        else if (name == "stats")
+            options.stats = weight;
+        else
+            return false;
+    }
+    return options.list + options.add + options.remove + options.stats > 0;
+}
+
+// Sends requests on one connection at `rate` per second until `end`.
+ConnectionResult runConnection(const Options &options, int index, double rate, const Filter &filter,
+                               std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    ConnectionResult result;
+    const int fd = connectToServer(options.socketPath);
+    if (fd < 0)
+    {
+        result.failures++;
+        return result;
+    }
+
+    std::mt19937 random(static_cast<unsigned>(index) + 1);
+    std::discrete_distribution<int> pick({double(options.list), double(options.add), double(options.remove), double(options.stats)});
+    const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate));
+    // Added events are tagged so that the deletes only remove what the load generator added.
+    const std::string tag = "loadgen-" + std::to_string(index);
+    std::size_t added = 0;
+    std::size_t deleted = 0;
+
+    std::uint32_t id = 0;
+    for (auto due = start; due < end; due += interval)
+    {
+        std::this_thread::sleep_until(due);
+        // A daemon that can't keep up would otherwise stretch the run until the
+        // whole backlog is sent; stop on time and report what was left instead.
+        if (std::chrono::steady_clock::now() >= end)
+        {
+            result.unsent = static_cast<std::size_t>((end - due + interval - std::chrono::steady_clock::duration(1)) / interval);
+            break;
+        }
+
+        std::string request;
+        switch (pick(random))
+        {
+        case 0:
+            request = protocol::encodeQuery(id, filter, std::nullopt);
+            break;
+        case 1:
+            request = protocol::encodeCommand(id, {"add", "--date", "2030-01-01", "--category", tag, "--description", std::to_string(added++)}, std::nullopt);
+            break;
+        case 2:
+            // Deletes the oldest event this connection added, if there is one left.
+            request = protocol::encodeCommand(
+                id, {"delete", "--where", "category = " + tag + " and description = \"" + std::to_string(deleted < added ? deleted++ : deleted) + "\""}, std::nullopt);
+            break;
+        default:
+            request = protocol::encodeCommand(id, {"stats"}, std::nullopt);
+            break;
+        }
+
+        bool failed = false;
+        auto check = [&](const std::string &payload)
+        {
+            const auto response = protocol::decodeResponse(payload);
+            if (!response.has_value() || response->id != id)
+                return false;
+            failed = response->status == protocol::Status::Error;
+            return true;
+        };
+        const bool exchanged = exchangeFrames(fd, {request}, check);
+        id++;
+        if (!exchanged)
+        {
+            result.failures++;
+            break;
+        }
+        if (failed)
+            result.errors++;
+        const std::chrono::duration<double, std::micro> latency = std::chrono::steady_clock::now() - due;
+        result.latencies.push_back(latency.count());
+    }
+
+    // Leave the events file the way it was found.
+    exchangeFrames(fd, {protocol::encodeCommand(id, {"delete", "--where", "category = " + tag}, std::nullopt)},
+                   [](const std::string &) { return true; });
+    close(fd);
+    return result;
+}
+
+// Returns the `fraction` percentile of the sorted `values`.
+double getPercentile(const std::vector<double> &values, double fraction)
+{
+    if (values.empty())
+        return 0;
+    const auto index = static_cast<std::size_t>(fraction * static_cast<double>(values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+void printUsage()
+{
+    std::cerr << "usage: days-loadgen [--socket <path>] [--connections N] [--rate <requests/s>] [--duration <s>]\n"
+                 "                    [--mix list=N,add=N,delete=N,stats=N] [--where <expression>]"
+              << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (const char *home = std::getenv("HOME"); home != nullptr)
+        options.socketPath = std::string(home) + "/.days/days.sock";
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            printUsage();
+            return 1;
+        }
+        const std::string value = argv[++i];
+        if (option == "--socket")
+            options.socketPath = value;
+        else if (option == "--connections")
+            options.connections = std::max(std::stoi(value), 1);
+        else if (option == "--rate")
+            options.rate = std::stod(value);
+        else if (option == "--duration")
+            options.duration = std::stod(value);
+        else if (option == "--where")
+            options.where = value;
+        else if (option == "--mix" && parseMix(value, options))
+            continue;
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if (options.rate <= 0 || options.duration <= 0)
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::string error;
+    const auto filter = Filter::compile(options.where, error);
+    if (!filter.has_value())
+    {
+        std::cerr << "Invalid --where filter: " << error << std::endl;
+        return 1;
+    }
+
+    // Every connection starts on the same schedule, staggered so that their
+    // requests interleave instead of arriving in bursts.
+    const double connectionRate = options.rate / options.connections;
+    const auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    const auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.duration));
+    std::vector<ConnectionResult> results(options.connections);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.connections; i++)
+    {
+        const auto offset = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(i / options.rate));
+        threads.emplace_back([&, i, offset]()
+                             { results[i] = runConnection(options, i, connectionRate, filter.value(), start + offset, end); });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<double> latencies;
+    std::size_t failures = 0;
+    std::size_t errors = 0;
+    std::size_t unsent = 0;
+    for (auto &result : results)
+    {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        failures += result.failures;
+        errors += result.errors;
+        unsent += result.unsent;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "requests: " << latencies.size() << " in " << elapsed.count() << " s ("
+              << latencies.size() / elapsed.count() << "/s, target " << options.rate << "/s)" << std::endl;
+    if (unsent > 0)
+        std::cout << "unsent: " << unsent << " requests were still due when the run ended" << std::endl;
+    if (errors > 0 || failures > 0)
+        std::cout << "errors: " << errors << ", failed connections: " << failures << std::endl;
+    std::cout << "latency (us, corrected for coordinated omission):" << std::endl;
+    for (const auto &[label, fraction] : std::vector<std::pair<const char *, double>>{
+             {"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p99.9", 0.999}, {"max", 1.0}})
+    {
+        std::cout << "  " << std::setw(6) << label << std::setw(12) << getPercentile(latencies, fraction) << std::endl;
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+#include "perfecthash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+PerfectHash PerfectHash::build(const std::vector<std::string_view>& keys) {
+    PerfectHash function;
+    const auto count = static_cast<std::uint32_t>(keys.size());
+    if (count == 0) {
+        return function;
+    }
+    function.displacements.assign((count + 2) / 3, 0);
+
+    std::vector<std::uint64_t> hashes(count);
+    std::vector<std::uint32_t> order(count); // the keys grouped by bucket
+    std::vector<std::uint32_t> bucketStarts(function.displacements.size() + 1);
+    std::vector<std::uint32_t> buckets(function.displacements.size());
+    std::vector<std::uint32_t> idOfKey(count);
+    std::vector<bool> taken(count);
+    std::vector<std::uint32_t> slots;
+
+    // A seed fails when two keys hash alike or a bucket finds no displacement
+    // within the limit; the next seed starts over.
+    constexpr std::uint32_t displacementLimit = 1u << 24;
+    for (std::uint64_t seed = 0;; seed++) {
+        function.seed = seed * 0x2545f4914f6cdd1d;
+        std::fill(bucketStarts.begin(), bucketStarts.end(), 0);
+        for (std::uint32_t key = 0; key < count; key++) {
+            hashes[key] = getHash(keys[key], function.seed);
+            bucketStarts[function.getBucket(hashes[key]) + 1]++;
+        }
+        std::partial_sum(bucketStarts.begin(), bucketStarts.end(), bucketStarts.begin());
+        {
+            auto next = bucketStarts;
+            for (std::uint32_t key = 0; key < count; key++) {
+                order[next[function.getBucket(hashes[key])]++] = key;
+            }
+        }
+        std::iota(buckets.begin(), buckets.end(), 0);
+        std::stable_sort(buckets.begin(), buckets.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return bucketStarts[a + 1] - bucketStarts[a] > bucketStarts[b + 1] - bucketStarts[b];
+        });
+
+        std::fill(taken.begin(), taken.end(), false);
+        bool placed = true;
+        for (const std::uint32_t bucket : buckets) {
+            const std::uint32_t first = bucketStarts[bucket];
+            const std::uint32_t last = bucketStarts[bucket + 1];
+            if (first == last) {
+                break; // the rest are empty too
+            }
+            std::uint32_t displacement = 0;
+            for (; displacement < displacementLimit; displacement++) {
+                slots.clear();
+                bool fits = true;
+                for (std::uint32_t i = first; i < last && fits; i++) {
+                    const std::uint32_t slot = getSlot(hashes[order[i]], displacement, count);
+                    fits = !taken[slot] && std::find(slots.begin(), slots.end(), slot) == slots.end();
+                    slots.push_back(slot);
+                }
+                if (fits) {
+                    break;
+                }
+            }
+            if (displacement == displacementLimit) {
+                placed = false;
+                break;
+            }
+            function.displacements[bucket] = displacement;
+            for (std::uint32_t i = first; i < last; i++) {
+                idOfKey[order[i]] = slots[i - first];
+                taken[slots[i - first]] = true;
+            }
+        }
+        if (placed) {
+            break;
+        }
+    }
+
+    function.keys.resize(count);
+    for (std::uint32_t key = 0; key < count; key++) {
+        function.keys[idOfKey[key]] = PrefixString(keys[key]);
+    }
+    return function;
+}
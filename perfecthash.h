@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "prefixstring.h"
+
+// A minimal perfect hash function over a fixed set of strings: each of the n
+// keys gets its own id in [0, n), and looking a string up takes one hash and
+// one comparison with the only key it can be, with no probing.
+//
+// It is built by hash and displace. The keys are hashed into buckets of about
+// three, and the buckets, biggest first, each search for a displacement that
+// sends all their keys to ids no other key has taken yet. A lookup hashes the
+// string once, picks its bucket from the high bits and its id from the hash
+// mixed with the bucket's displacement.
+class PerfectHash {
+public:
+    PerfectHash() = default;
+
+    // Builds the function over `keys`, which must be distinct.
+    static PerfectHash build(const std::vector<std::string_view>& keys);
+
+    // Returns the id of `key`, or `std::nullopt` if it is not one of the keys.
+    std::optional<std::uint32_t> find(std::string_view key) const {
+        if (keys.empty()) {
+            return std::nullopt;
+        }
+        const std::uint32_t id = getId(getHash(key, seed));
+        if (keys[id] != key) {
+            return std::nullopt;
+        }
+        return id;
+    }
+
+    // Returns the key with the id `id`.
+    const PrefixString& getKey(std::uint32_t id) const { return keys[id]; }
+
+    std::size_t size() const { return keys.size(); }
+
+    // Returns the size of the function, without the keys, in bytes.
+    std::size_t getFunctionBytes() const { return displacements.size() * sizeof(std::uint32_t); }
+
+private:
+    static std::uint64_t getHash(std::string_view key, std::uint64_t seed) {
+        // Eight bytes at a time, each word multiplied in and folded, so that the
+        // bucket (the high bits) and the id both depend on every byte. The tail is
+        // read with fixed-size loads that may overlap bytes already read, since a
+        // copy of a variable length is a call.
+        const char* data = key.data();
+        const std::size_t size = key.size();
+        std::uint64_t hash = seed ^ (size * 0x9e3779b97f4a7c15);
+        auto add = [&hash](std::uint64_t word) {
+            hash = (hash ^ word) * 0xff51afd7ed558ccd;
+            hash ^= hash >> 32;
+        };
+        if (size >= 8) {
+            std::size_t i = 0;
+            for (; i + 8 <= size; i += 8) {
+                add(load<std::uint64_t>(data + i));
+            }
+            if (i < size) {
+                add(load<std::uint64_t>(data + size - 8));
+            }
+        } else if (size >= 4) {
+            add(load<std::uint32_t>(data) | static_cast<std::uint64_t>(load<std::uint32_t>(data + size - 4)) << 32);
+        } else if (size > 0) {
+            const auto byte = [data](std::size_t i) { return static_cast<std::uint64_t>(static_cast<unsigned char>(data[i])); };
+            add(byte(0) | byte(size / 2) << 8 | byte(size - 1) << 16);
+        }
+        hash = (hash ^ (hash >> 29)) * 0xbf58476d1ce4e5b9;
+        return hash ^ (hash >> 32);
+    }
+
+    template <typename Word>
+    static Word load(const char* data) {
+        Word word;
+        std::memcpy(&word, data, sizeof word);
+        return word;
+    }
+
+    std::uint32_t getBucket(std::uint64_t hash) const {
+        return static_cast<std::uint32_t>(((hash >> 32) * displacements.size()) >> 32);
+    }
+
+    std::uint32_t getId(std::uint64_t hash) const {
+        return getSlot(hash, displacements[getBucket(hash)], static_cast<std::uint32_t>(keys.size()));
+    }
+
+    static std::uint32_t getSlot(std::uint64_t hash, std::uint32_t displacement, std::uint32_t count) {
+        std::uint64_t mixed = (hash ^ (displacement * 0x9e3779b97f4a7c15)) * 0xbf58476d1ce4e5b9;
+        mixed ^= mixed >> 31;
+        return static_cast<std::uint32_t>(((mixed & 0xffffffff) * count) >> 32);
+    }
+
+    std::uint64_t seed = 0;
+    std::vector<std::uint32_t> displacements; // one for each bucket
+    std::vector<PrefixString> keys;           // by id
+};
@@ -0,0 +1,50 @@
+#include "prefixstring.h"
+
+#include <ostream>
+#include <utility>
+
+PrefixString::PrefixString(std::string_view text) : length(static_cast<std::uint32_t>(text.size())) {
+    if (isInlined()) {
+        std::memcpy(inlined, text.data(), text.size());
+        return;
+    }
+    char* copy = new char[text.size()];
+    std::memcpy(copy, text.data(), text.size());
+    std::memcpy(inlined, text.data(), 4);
+    std::memcpy(inlined + 4, &copy, sizeof copy);
+}
+
+PrefixString::PrefixString(PrefixString&& other) noexcept : length(other.length) {
+    std::memcpy(inlined, other.inlined, sizeof inlined);
+    other.length = 0;
+    std::memset(other.inlined, 0, sizeof other.inlined);
+}
+
+PrefixString& PrefixString::operator=(const PrefixString& other) {
+    if (this != &other) {
+        *this = PrefixString(other);
+    }
+    return *this;
+}
+
+PrefixString& PrefixString::operator=(PrefixString&& other) noexcept {
+    if (this != &other) {
+        if (!isInlined()) {
+            delete[] data();
+        }
+        length = std::exchange(other.length, 0);
+        std::memcpy(inlined, other.inlined, sizeof inlined);
+        std::memset(other.inlined, 0, sizeof other.inlined);
+    }
+    return *this;
+}
+
+PrefixString::~PrefixString() {
+    if (!isInlined()) {
+        delete[] data();
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, const PrefixString& text) {
+    return os << text.view();
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+// An immutable string in 16 bytes, laid out as in Umbra:
+//
+//     u32 length | char[12] inlined                        (up to 12 bytes)
+//     u32 length | char[4] prefix | char* the whole string (longer)
+//
+// The first four bytes of the string are always next to its length, so most
+// comparisons of categories and descriptions are decided by the first eight
+// bytes without following a pointer, and short strings (most categories) don't
+// allocate at all. Unused inlined bytes are zero.
+class PrefixString {
+public:
+    static constexpr std::size_t maxInlined = 12;
+
+    PrefixString() = default;
+    explicit PrefixString(std::string_view text);
+    PrefixString(const PrefixString& other) : PrefixString(other.view()) {}
+    PrefixString(PrefixString&& other) noexcept;
+    PrefixString& operator=(const PrefixString& other);
+    PrefixString& operator=(PrefixString&& other) noexcept;
+    ~PrefixString();
+
+    std::size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    bool isInlined() const { return length <= maxInlined; }
+
+    const char* data() const {
+        if (isInlined()) {
+            return inlined;
+        }
+        const char* pointer;
+        std::memcpy(&pointer, inlined + 4, sizeof pointer);
+        return pointer;
+    }
+
+    std::string_view view() const { return {data(), length}; }
+    operator std::string_view() const { return view(); }
+    std::string str() const { return std::string(view()); }
+
+    bool starts_with(std::string_view text) const {
+        if (text.size() > length) {
+            return false;
+        }
+        const std::size_t head = text.size() < 4 ? text.size() : 4;
+        return std::memcmp(inlined, text.data(), head) == 0 &&
+               std::memcmp(data() + head, text.data() + head, text.size() - head) == 0;
+    }
+
+    bool operator==(const PrefixString& other) const {
+        if (getHead() != other.getHead()) {
+            return false;
+        }
+        if (isInlined()) {
+            return std::memcmp(inlined + 4, other.inlined + 4, 8) == 0;
+        }
+        return std::memcmp(data() + 4, other.data() + 4, length - 4) == 0;
+    }
+
+    bool operator==(std::string_view text) const {
+        if (text.size() != length) {
+            return false;
+        }
+        const std::size_t head = length < 4 ? length : 4;
+        return std::memcmp(inlined, text.data(), head) == 0 &&
+               std::memcmp(data() + head, text.data() + head, length - head) == 0;
+    }
+
+    std::strong_ordering operator<=>(const PrefixString& other) const {
+        // The zero padding sorts a short prefix before a longer one, so unequal
+        // prefixes order the strings the same as their bytes do.
+        const int prefix = std::memcmp(inlined, other.inlined, 4);
+        if (prefix != 0) {
+            return prefix <=> 0;
+        }
+        return view().compare(other.view()) <=> 0;
+    }
+
+private:
+    // The length and the prefix as one word, for comparing both at once.
+    std::uint64_t getHead() const {
+        std::uint64_t head;
+        std::memcpy(&head, this, sizeof head);
+        return head;
+    }
+
+    std::uint32_t length = 0;
+    char inlined[maxInlined] = {};
+};
+
+static_assert(sizeof(PrefixString) == 16);
+
+std::ostream& operator<<(std::ostream& os, const PrefixString& text);
@@ -0,0 +1,46 @@
+#include "prepared.h"
+
+#include <mutex>
+
+std::optional<std::uint32_t> PreparedQueries::prepare(Filter filter) {
+    auto prepared = std::make_shared<Prepared>();
+    prepared->plan.store(std::make_shared<const QueryPlan>(filter));
+    prepared->boundDay.store(INT32_MIN); // plans of relative filters get bound on first use
+    prepared->filter = std::move(filter);
+
+    std::unique_lock lock(mutex);
+    if (queries.size() >= maxQueries) {
+        return std::nullopt;
+    }
+    const std::uint32_t handle = nextHandle++;
+    queries.emplace(handle, std::move(prepared));
+    return handle;
+}
+
+std::shared_ptr<const QueryPlan> PreparedQueries::getPlan(std::uint32_t handle, std::int32_t today) {
+    std::shared_ptr<Prepared> prepared;
+    {
+        std::shared_lock lock(mutex);
+        const auto found = queries.find(handle);
+        if (found == queries.end()) {
+            return nullptr;
+        }
+        prepared = found->second;
+    }
+
+    if (!prepared->filter.isRelative() || prepared->boundDay.load() == today) {
+        return prepared->plan.load();
+    }
+    // Two executions on the day change may both re-plan; either plan is right.
+    Filter filter = prepared->filter;
+    filter.bind(today);
+    auto plan = std::make_shared<const QueryPlan>(std::move(filter));
+    prepared->plan.store(plan);
+    prepared->boundDay.store(today);
+    return plan;
+}
+
+bool PreparedQueries::release(std::uint32_t handle) {
+    std::unique_lock lock(mutex);
+    return queries.erase(handle) > 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "filter.h"
+#include "kernels.h"
+
+// The queries prepared by the clients of the daemon, by handle. A prepared query
+// is compiled and planned once; executing it only looks up the plan. Plans of
+// filters with relative dates (`date >= today-7`) are re-bound and re-planned
+// once when the day changes, not on every execution.
+class PreparedQueries {
+public:
+    // Enough for the queries of many dashboards, while a client that never
+    // releases its queries can't use up the daemon's memory.
+    static constexpr std::size_t maxQueries = 4096;
+
+    // Returns the handle of the prepared `filter`, or `std::nullopt` if there
+    // are too many prepared queries.
+    std::optional<std::uint32_t> prepare(Filter filter);
+
+    // Returns the plan of the query with `handle` for `today`, a day number, or
+    // nullptr if there is no such query.
+    std::shared_ptr<const QueryPlan> getPlan(std::uint32_t handle, std::int32_t today);
+
+    // Forgets the query with `handle`. Returns false if there was no such query.
+    bool release(std::uint32_t handle);
+
+private:
+    struct Prepared {
+        Filter filter; // as prepared, bound again for each day
+        std::atomic<std::shared_ptr<const QueryPlan>> plan;
+        std::atomic<std::int32_t> boundDay;
+    };
+
+    std::shared_mutex mutex;
+    std::unordered_map<std::uint32_t, std::shared_ptr<Prepared>> queries;
+    std::uint32_t nextHandle = 1;
+};
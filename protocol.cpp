@@ -0,0 +1,373 @@
+#include "protocol.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace protocol {
+
+namespace {
+
+// The time column's value for an event without a time of day.
+constexpr std::uint16_t noTime = 0xffff;
+
+void writeHeader(WireWriter& out, std::uint32_t id, Op op, std::optional<std::chrono::milliseconds> timeout) {
+    out.u32(id);
+    out.u8(static_cast<std::uint8_t>(op));
+    // A zero timeout means none, so the shortest real one is a millisecond.
+    out.u32(timeout.has_value() ? static_cast<std::uint32_t>(std::max<std::int64_t>(timeout->count(), 1)) : 0);
+}
+
+// Writes the `rows` of `events` as the body of a `Rows` response.
+void writeRows(WireWriter& out, const std::vector<Event>& events, const std::vector<std::uint32_t>& rows) {
+    out.u32(static_cast<std::uint32_t>(rows.size()));
+    for (auto row : rows) {
+        out.i32(events[row].getDayNumber());
+    }
+    for (auto row : rows) {
+        const auto time = events[row].getTime();
+        out.u16(time.has_value() ? static_cast<std::uint16_t>(time->count()) : noTime);
+    }
+    std::uint32_t end = 0;
+    for (auto row : rows) {
+        end += static_cast<std::uint32_t>(events[row].getCategory().size());
+        out.u32(end);
+        end += static_cast<std::uint32_t>(events[row].getDescription().size());
+        out.u32(end);
+    }
+    for (auto row : rows) {
+        out.bytes(events[row].getCategory());
+        out.bytes(events[row].getDescription());
+    }
+}
+
+// Returns the bytes that `writeRows` needs for the `rows` of `events`.
+std::size_t getRowsSize(const std::vector<Event>& events, const std::vector<std::uint32_t>& rows) {
+    std::size_t stringBytes = 0;
+    for (auto row : rows) {
+        stringBytes += events[row].getCategory().size() + events[row].getDescription().size();
+    }
+    return 4 + rows.size() * 14 + stringBytes;
+}
+
+// Reads the rest of `in` as the body of a `Rows` response into `events`. Returns
+// false if it is not valid.
+bool readRows(WireReader& in, std::vector<Event>& events) {
+    const std::uint32_t count = in.u32();
+    if (!in.isValid() || count > in.remaining() / 14) {
+        return false;
+    }
+    const std::string_view days = in.bytes(count * std::size_t{4});
+    const std::string_view times = in.bytes(count * std::size_t{2});
+    const std::string_view ends = in.bytes(count * std::size_t{8});
+    const std::string_view strings = in.bytes(in.remaining());
+
+    WireReader dayReader(days);
+    WireReader timeReader(times);
+    WireReader endReader(ends);
+    events.reserve(count);
+    std::uint32_t start = 0;
+    for (std::uint32_t i = 0; i < count; i++) {
+        const std::chrono::sys_days day{std::chrono::days{dayReader.i32()}};
+        const std::uint16_t time = timeReader.u16();
+        const std::uint32_t categoryEnd = endReader.u32();
+        const std::uint32_t descriptionEnd = endReader.u32();
+        if (categoryEnd < start || descriptionEnd < categoryEnd || descriptionEnd > strings.size() ||
+            (time != noTime && time >= 24 * 60)) {
+            return false;
+        }
+        events.emplace_back(
+            std::chrono::year_month_day{day},
+            strings.substr(start, categoryEnd - start),
+            strings.substr(categoryEnd, descriptionEnd - categoryEnd),
+            time != noTime ? std::optional<std::chrono::minutes>{time} : std::nullopt);
+        start = descriptionEnd;
+    }
+    return true;
+}
+
+}
+
+std::string encodeQuery(std::uint32_t id, const Filter& filter, std::optional<std::chrono::milliseconds> timeout) {
+    std::string buffer;
+    WireWriter out(buffer);
+    writeHeader(out, id, Op::Query, timeout);
+    filter.serialize(buffer);
+    return buffer;
+}
+
+std::string encodeCommand(std::uint32_t id, const std::vector<std::string>& words,
+                          std::optional<std::chrono::milliseconds> timeout) {
+    std::string buffer;
+    WireWriter out(buffer);
+    writeHeader(out, id, Op::Command, timeout);
+    for (std::size_t i = 0; i < words.size(); i++) {
+        if (i > 0) {
+            out.u8(0);
+        }
+        out.bytes(words[i]);
+    }
+    return buffer;
+}
+
+std::string encodePrepare(std::uint32_t id, const Filter& filter) {
+    std::string buffer;
+    WireWriter out(buffer);
+    writeHeader(out, id, Op::Prepare, std::nullopt);
+    filter.serialize(buffer);
+    return buffer;
+}
+
+std::string encodeExecute(std::uint32_t id, std::uint32_t handle, std::optional<std::chrono::milliseconds> timeout) {
+    std::string buffer;
+    WireWriter out(buffer);
+    writeHeader(out, id, Op::Execute, timeout);
+    out.u32(handle);
+    return buffer;
+}
+
+std::string encodeRelease(std::uint32_t id, std::uint32_t handle) {
+    std::string buffer;
+    WireWriter out(buffer);
+    writeHeader(out, id, Op::Release, std::nullopt);
+    out.u32(handle);
+    return buffer;
+}
+
+std::string encodeMultiQuery(std::uint32_t id, const std::vector<Filter>& filters,
+                             std::optional<std::chrono::milliseconds> timeout) {
+    std::string buffer;
+    WireWriter out(buffer);
+    writeHeader(out, id, Op::MultiQuery, timeout);
+    out.u32(static_cast<std::uint32_t>(filters.size()));
+    std::string program;
+    for (const auto& filter : filters) {
+        program.clear();
+        filter.serialize(program);
+        out.u32(static_cast<std::uint32_t>(program.size()));
+        out.bytes(program);
+    }
+    return buffer;
+}
+
+std::optional<Request> decodeRequest(std::string_view data, std::string& error) {
+    WireReader in(data);
+    Request request;
+    request.id = in.u32();
+    const std::uint8_t op = in.u8();
+    const std::uint32_t timeout = in.u32();
+    if (!in.isValid()) {
+        error = "truncated request";
+        return std::nullopt;
+    }
+    if (timeout != 0) {
+        request.timeout = std::chrono::milliseconds{timeout};
+    }
+
+    const std::string_view body = in.bytes(in.remaining());
+    switch (op) {
+    case static_cast<std::uint8_t>(Op::Query):
+    case static_cast<std::uint8_t>(Op::Prepare):
+        request.op = static_cast<Op>(op);
+        request.filter = Filter::deserialize(body, error);
+        if (!request.filter.has_value()) {
+            return std::nullopt;
+        }
+        break;
+    case static_cast<std::uint8_t>(Op::Execute):
+    case static_cast<std::uint8_t>(Op::Release): {
+        request.op = static_cast<Op>(op);
+        WireReader handle(body);
+        request.handle = handle.u32();
+        if (!handle.isValid() || handle.remaining() != 0) {
+            error = "truncated request";
+            return std::nullopt;
+        }
+        break;
+    }
+    case static_cast<std::uint8_t>(Op::MultiQuery): {
+        request.op = Op::MultiQuery;
+        WireReader filters(body);
+        const std::uint32_t count = filters.u32();
+        if (!filters.isValid() || count > filters.remaining() / 4) {
+            error = "truncated request";
+            return std::nullopt;
+        }
+        request.filters.reserve(count);
+        for (std::uint32_t i = 0; i < count; i++) {
+            const std::uint32_t size = filters.u32();
+            const std::string_view program = filters.bytes(size);
+            if (!filters.isValid()) {
+                error = "truncated request";
+                return std::nullopt;
+            }
+            auto filter = Filter::deserialize(program, error);
+            if (!filter.has_value()) {
+                return std::nullopt;
+            }
+            request.filters.push_back(std::move(filter.value()));
+        }
+        if (filters.remaining() != 0) {
+            error = "truncated request";
+            return std::nullopt;
+        }
+        break;
+    }
+    case static_cast<std::uint8_t>(Op::Command):
+        request.op = Op::Command;
+        for (std::size_t start = 0; !body.empty() && start <= body.size();) {
+            const auto end = std::min(body.find('\0', start), body.size());
+            request.words.emplace_back(body.substr(start, end - start));
+            start = end + 1;
+        }
+        if (request.words.empty()) {
+            error = "empty command";
+            return std::nullopt;
+        }
+        break;
+    default:
+        error = "unknown request";
+        return std::nullopt;
+    }
+    return request;
+}
+
+std::string encodeRows(std::uint32_t id, const std::vector<Event>& events, const std::vector<std::uint32_t>& rows) {
+    std::string buffer;
+    buffer.reserve(5 + getRowsSize(events, rows));
+    WireWriter out(buffer);
+    out.u32(id);
+    out.u8(static_cast<std::uint8_t>(Status::Rows));
+    writeRows(out, events, rows);
+    return buffer;
+}
+
+std::string encodeRows(std::uint32_t id, const std::vector<Event>& events) {
+    std::vector<std::uint32_t> rows(events.size());
+    std::iota(rows.begin(), rows.end(), 0);
+    return encodeRows(id, events, rows);
+}
+
+std::string encodeRowSets(std::uint32_t id, const std::vector<Event>& events,
+                          const std::vector<std::vector<std::uint32_t>>& rowSets) {
+    // An event that matches several queries is sent once: the events in any set
+    // are the rows to send, and each set is renumbered into positions among them.
+    constexpr std::uint32_t unsent = UINT32_MAX;
+    std::vector<std::uint32_t> positions(events.size(), unsent);
+    std::size_t total = 0;
+    for (const auto& set : rowSets) {
+        for (auto row : set) {
+            positions[row] = 0;
+        }
+        total += set.size();
+    }
+    std::vector<std::uint32_t> rows;
+    for (std::uint32_t row = 0; row < positions.size(); row++) {
+        if (positions[row] != unsent) {
+            positions[row] = static_cast<std::uint32_t>(rows.size());
+            rows.push_back(row);
+        }
+    }
+
+    std::string buffer;
+    buffer.reserve(9 + (rowSets.size() + total) * 4 + getRowsSize(events, rows));
+    WireWriter out(buffer);
+    out.u32(id);
+    out.u8(static_cast<std::uint8_t>(Status::RowSets));
+    out.u32(static_cast<std::uint32_t>(rowSets.size()));
+    for (const auto& set : rowSets) {
+        out.u32(static_cast<std::uint32_t>(set.size()));
+    }
+    for (const auto& set : rowSets) {
+        for (auto row : set) {
+            out.u32(positions[row]);
+        }
+    }
+    writeRows(out, events, rows);
+    return buffer;
+}
+
+std::string encodeText(std::uint32_t id, Status status, std::string_view text) {
+    std::string buffer;
+    WireWriter out(buffer);
+    out.u32(id);
+    out.u8(static_cast<std::uint8_t>(status));
+    out.bytes(text);
+    return buffer;
+}
+
+std::string encodeHandle(std::uint32_t id, std::uint32_t handle) {
+    std::string buffer;
+    WireWriter out(buffer);
+    out.u32(id);
+    out.u8(static_cast<std::uint8_t>(Status::Handle));
+    out.u32(handle);
+    return buffer;
+}
+
+std::optional<Response> decodeResponse(std::string_view data) {
+    WireReader in(data);
+    Response response;
+    response.id = in.u32();
+    const std::uint8_t status = in.u8();
+    if (!in.isValid()) {
+        return std::nullopt;
+    }
+
+    if (status == static_cast<std::uint8_t>(Status::Text) || status == static_cast<std::uint8_t>(Status::Error)) {
+        response.status = static_cast<Status>(status);
+        response.text = in.bytes(in.remaining());
+        return response;
+    }
+    if (status == static_cast<std::uint8_t>(Status::Handle)) {
+        response.status = Status::Handle;
+        response.handle = in.u32();
+        if (!in.isValid()) {
+            return std::nullopt;
+        }
+        return response;
+    }
+    if (status == static_cast<std::uint8_t>(Status::RowSets)) {
+        response.status = Status::RowSets;
+        const std::uint32_t count = in.u32();
+        if (!in.isValid() || count > in.remaining() / 4) {
+            return std::nullopt;
+        }
+        std::vector<std::uint32_t> sizes(count);
+        for (auto& size : sizes) {
+            size = in.u32();
+        }
+        response.rowSets.resize(count);
+        for (std::uint32_t i = 0; i < count && in.isValid(); i++) {
+            if (sizes[i] > in.remaining() / 4) {
+                return std::nullopt;
+            }
+            response.rowSets[i].resize(sizes[i]);
+            for (auto& position : response.rowSets[i]) {
+                position = in.u32();
+            }
+        }
+        if (!in.isValid() || !readRows(in, response.events)) {
+            return std::nullopt;
+        }
+        for (const auto& set : response.rowSets) {
+            for (auto position : set) {
+                if (position >= response.events.size()) {
+                    return std::nullopt;
+                }
+            }
+        }
+        return response;
+    }
+    if (status != static_cast<std::uint8_t>(Status::Rows)) {
+        return std::nullopt;
+    }
+
+    response.status = Status::Rows;
+    if (!readRows(in, response.events)) {
+        return std::nullopt;
+    }
+    return response;
+}
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "event.h"
+#include "filter.h"
+
+// The messages spoken on the daemon socket, one per frame (see server.h). All
+// integers are little endian.
+//
+//   request:  u32 id | u8 op | u32 timeout in ms, 0 for none | body
+//     Query      a compiled filter (`Filter::serialize`)
+//     Command    the words of a command line, NUL separated
+//     Prepare    a compiled filter, kept by the daemon under a handle
+//     Execute    u32 handle of a prepared query
+//     Release    u32 handle of a prepared query
+//     MultiQuery u32 count | (u32 size | compiled filter)[count], run in one scan
+//
+//   response: u32 id | u8 status | body
+//     Rows       u32 count | i32 day[count] | u16 time[count] | u32 end[2 * count] | string bytes
+//     Text       what the command printed
+//     Error      why the request failed
+//     Handle     u32 handle, the response to Prepare
+//     RowSets    u32 count | u32 size[count] | u32 position[sum of sizes] | rows as in Rows,
+//                the response to MultiQuery
+//
+// The rows of a `Rows` response are columns: the day numbers, the times of day
+// in minutes since midnight (0xffff for none), then the end offsets of each
+// row's category and description in the string bytes that follow, so the
+// client unpacks them without parsing any text. A `RowSets` response sends the
+// events that match any of its queries once, as rows, after the positions among
+// them of the events of each query.
+//
+// The id is chosen by the client and echoed in the response. Clients can send
+// any number of requests without waiting; responses come back in request
+// order, so the id only has to confirm which request a response belongs to.
+namespace protocol {
+
+enum class Op : std::uint8_t {
+    Query = 1,
+    Command = 2,
+    Prepare = 3,
+    Execute = 4,
+    Release = 5,
+    MultiQuery = 6,
+};
+
+enum class Status : std::uint8_t {
+    Rows = 1,
+    Text = 2,
+    Error = 3,
+    Handle = 4,
+    RowSets = 5,
+};
+
+struct Request {
+    std::uint32_t id = 0;
+    Op op = Op::Command;
+    std::optional<std::chrono::milliseconds> timeout;
+    std::optional<Filter> filter;   // for `Query` and `Prepare`
+    std::vector<Filter> filters;    // for `MultiQuery`
+    std::vector<std::string> words; // for `Command`
+    std::uint32_t handle = 0;       // for `Execute` and `Release`
+};
+
+struct Response {
+    std::uint32_t id = 0;
+    Status status = Status::Text;
+    std::vector<Event> events; // for `Rows` and `RowSets`
+    std::vector<std::vector<std::uint32_t>> rowSets; // for `RowSets`, positions in `events`
+    std::string text;          // for `Text` and `Error`
+    std::uint32_t handle = 0;  // for `Handle`
+};
+
+std::string encodeQuery(std::uint32_t id, const Filter& filter, std::optional<std::chrono::milliseconds> timeout);
+std::string encodeCommand(std::uint32_t id, const std::vector<std::string>& words,
+                          std::optional<std::chrono::milliseconds> timeout);
+std::string encodePrepare(std::uint32_t id, const Filter& filter);
+std::string encodeExecute(std::uint32_t id, std::uint32_t handle, std::optional<std::chrono::milliseconds> timeout);
+std::string encodeRelease(std::uint32_t id, std::uint32_t handle);
+std::string encodeMultiQuery(std::uint32_t id, const std::vector<Filter>& filters,
+                             std::optional<std::chrono::milliseconds> timeout);
+
+// Returns `std::nullopt` and sets `error` if `data` is not a valid request.
+std::optional<Request> decodeRequest(std::string_view data, std::string& error);
+
+// Encodes the `rows` of `events` as a `Rows` response.
+std::string encodeRows(std::uint32_t id, const std::vector<Event>& events, const std::vector<std::uint32_t>& rows);
+
+// Encodes all of `events` as a `Rows` response.
+std::string encodeRows(std::uint32_t id, const std::vector<Event>& events);
+
+// Encodes the `rowSets` of `events`, one for each query of a `MultiQuery`, as a
+// `RowSets` response. Each set holds positions in `events`, in the order to list them.
+std::string encodeRowSets(std::uint32_t id, const std::vector<Event>& events,
+                          const std::vector<std::vector<std::uint32_t>>& rowSets);
+
+std::string encodeText(std::uint32_t id, Status status, std::string_view text);
+std::string encodeHandle(std::uint32_t id, std::uint32_t handle);
+
+// Returns `std::nullopt` if `data` is not a valid response.
+std::optional<Response> decodeResponse(std::string_view data);
+
+}
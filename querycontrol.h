@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+
+// Lets a running query be stopped from outside: either by a deadline, or by
+// another thread calling `cancel()`. Scans check `isStopped()` between blocks
+// of rows, so a query stops within one block of work after it is cancelled.
+class QueryControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    QueryControl() = default;
+
+    // Stops the query `timeout` after now.
+    explicit QueryControl(Clock::duration timeout) : deadline(Clock::now() + timeout) {}
+
+    QueryControl(const QueryControl&) = delete;
+    QueryControl& operator=(const QueryControl&) = delete;
+
+    // Asks the query to stop. Safe to call from any thread.
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+
+    bool isStopped() const {
+        return cancelled.load(std::memory_order_relaxed) ||
+               (deadline.has_value() && Clock::now() >= deadline.value());
+    }
+
+    // Returns true if the query was stopped by its deadline rather than cancelled.
+    bool isTimedOut() const {
+        return !cancelled.load(std::memory_order_relaxed) && deadline.has_value() && Clock::now() >= deadline.value();
+    }
+
+private:
+    std::atomic<bool> cancelled{false};
+    std::optional<Clock::time_point> deadline;
+};
@@ -0,0 +1,143 @@
+#include "reminders.h"
+
+#include <charconv>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+std::string trim(const std::string& text) {
+    const auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return {};
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+std::optional<std::chrono::minutes> getUnit(const std::string& unit) {
+    using namespace std::chrono;
+    if (unit == "minute" || unit == "minutes") {
+        return minutes{1};
+    }
+    if (unit == "hour" || unit == "hours") {
+        return hours{1};
+    }
+    if (unit == "day" || unit == "days") {
+        return days{1};
+    }
+    if (unit == "week" || unit == "weeks") {
+        return weeks{1};
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+bool ReminderRule::matches(const Event& event) const {
+    return !category.has_value() || event.getCategory() == category.value();
+}
+
+std::int64_t ReminderRule::getDue(const Event& event) const {
+    return getMinuteNumber(event.getTimestamp(), event.getTime().value_or(at)) - before.count();
+}
+
+std::optional<ReminderRule> parseReminderRule(const std::string& text, std::string& error) {
+    ReminderRule rule;
+    rule.text = trim(text);
+
+    std::istringstream clauses(rule.text);
+    bool first = true;
+    for (std::string clause; std::getline(clauses, clause, ',');) {
+        std::istringstream words(trim(clause));
+        std::string word;
+        words >> word;
+        if (first) {
+            // <count> <unit> before
+            long long count = -1;
+            const auto [end, code] = std::from_chars(word.data(), word.data() + word.size(), count);
+            std::string unit;
+            std::string before;
+            words >> unit >> before;
+            const auto size = getUnit(unit);
+            if (code != std::errc{} || end != word.data() + word.size() || count < 0 || count > 100000 ||
+                !size.has_value() || before != "before" || !words.eof()) {
+                error = "expected a rule like \"3 days before\", not \"" + trim(clause) + "\"";
+                return std::nullopt;
+            }
+            rule.before = size.value() * count;
+            first = false;
+        } else if (word == "category") {
+            std::string category;
+            std::getline(words >> std::ws, category);
+            if (category.empty()) {
+                error = "\"category\" needs a name";
+                return std::nullopt;
+            }
+            rule.category = category;
+        } else if (word == "at") {
+            std::string time;
+            words >> time;
+            const auto dateTime = getDateTimeFromString("1970-01-01T" + time);
+            if (!dateTime.has_value() || !words.eof()) {
+                error = "expected a time like \"at 09:00\", not \"" + trim(clause) + "\"";
+                return std::nullopt;
+            }
+            rule.at = dateTime->time.value();
+        } else {
+            error = "unknown clause \"" + trim(clause) + "\"";
+            return std::nullopt;
+        }
+    }
+    if (first) {
+        error = "expected a rule like \"3 days before\"";
+        return std::nullopt;
+    }
+    return rule;
+}
+
+std::vector<ReminderRule> readReminderRules(const std::filesystem::path& path, std::vector<std::string>& errors) {
+    std::vector<ReminderRule> rules;
+    std::ifstream file(path);
+    for (std::string line; std::getline(file, line);) {
+        const auto text = trim(line);
+        if (text.empty() || text.front() == '#') {
+            continue;
+        }
+        std::string error;
+        if (auto rule = parseReminderRule(text, error); rule.has_value()) {
+            rules.push_back(std::move(rule.value()));
+        } else {
+            errors.push_back(text + ": " + error);
+        }
+    }
+    return rules;
+}
+
+void ReminderSchedule::reset(const std::vector<Event>& events, const std::vector<ReminderRule>& rules) {
+    wheel.clear();
+    reminders.clear();
+    for (std::size_t i = 0; i < events.size(); i++) {
+        for (std::size_t j = 0; j < rules.size(); j++) {
+            if (!rules[j].matches(events[i])) {
+                continue;
+            }
+            const auto due = rules[j].getDue(events[i]);
+            if (due <= wheel.getNow()) {
+                continue;
+            }
+            wheel.schedule(due, static_cast<std::uint32_t>(reminders.size()));
+            reminders.push_back({due, static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(j)});
+        }
+    }
+}
+
+std::vector<ReminderSchedule::Reminder> ReminderSchedule::advance(std::int64_t now) {
+    fired.clear();
+    wheel.advance(now, fired);
+    std::vector<Reminder> due;
+    due.reserve(fired.size());
+    for (auto id : fired) {
+        due.push_back(reminders[id]);
+    }
+    return due;
+}
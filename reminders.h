@@ -0,0 +1,67 @@
+#pragma once
+
+#include "event.h"
+#include "timerwheel.h"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// A rule for reminding of events, as written in ~/.days/reminders, one per line:
+//
+//     3 days before, category work, at 08:30
+//
+// The first clause says how long before an event the reminder fires, in minutes,
+// hours, days or weeks. `category` limits the rule to the events of a category.
+// Events without a time are reminded of as if they were at the `at` time of
+// their day, 09:00 by default.
+struct ReminderRule {
+    std::chrono::minutes before{0};
+    std::optional<std::string> category;
+    std::chrono::minutes at{9 * 60};
+    std::string text; // as written
+
+    bool matches(const Event& event) const;
+
+    // Returns the minute number (see event.h) at which `event` is reminded of.
+    std::int64_t getDue(const Event& event) const;
+};
+
+// Parses a rule. Returns `std::nullopt` and sets `error` if `text` is not one.
+std::optional<ReminderRule> parseReminderRule(const std::string& text, std::string& error);
+
+// Reads the rules from `path`, skipping blank lines and lines starting with `#`.
+// A missing file means no rules. Lines that don't parse are reported in `errors`.
+std::vector<ReminderRule> readReminderRules(const std::filesystem::path& path, std::vector<std::string>& errors);
+
+// The reminders of a set of events, each on a timer wheel, so that scheduling
+// one costs the same however many there are.
+class ReminderSchedule {
+public:
+    struct Reminder {
+        std::int64_t due;
+        std::uint32_t event; // index into the events given to `reset`
+        std::uint32_t rule;  // index into the rules given to `reset`
+    };
+
+    // Starts with no reminders, with every minute up to `now` already passed.
+    explicit ReminderSchedule(std::int64_t now) : wheel(now) {}
+
+    // Replaces the reminders with those of `rules` for `events` that are due
+    // after the last minute passed.
+    void reset(const std::vector<Event>& events, const std::vector<ReminderRule>& rules);
+
+    std::size_t size() const { return reminders.size(); }
+
+    // Passes every minute up to `now`, returning the reminders that became due,
+    // in order.
+    std::vector<Reminder> advance(std::int64_t now);
+
+private:
+    TimerWheel wheel;
+    std::vector<Reminder> reminders;
+    std::vector<std::uint32_t> fired;
+};
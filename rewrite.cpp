@@ -0,0 +1,167 @@
+#include "rewrite.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Closes a file descriptor when it goes out of scope.
+struct FileDescriptor {
+    int fd = -1;
+    ~FileDescriptor() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+// Copies `length` bytes at `offset` of `from` to the end of `to` through a buffer,
+// for when the kernel can't copy them between the two files.
+bool copyThroughBuffer(int from, int to, std::uint64_t offset, std::uint64_t length) {
+    std::vector<char> buffer(1 << 20);
+    while (length > 0) {
+        const ssize_t count = pread(from, buffer.data(), std::min<std::uint64_t>(length, buffer.size()), static_cast<off_t>(offset));
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        for (ssize_t written = 0; written < count;) {
+            const ssize_t result = write(to, buffer.data() + written, static_cast<std::size_t>(count - written));
+            if (result < 0 && errno != EINTR) {
+                return false;
+            }
+            written += std::max<ssize_t>(result, 0);
+        }
+        offset += static_cast<std::uint64_t>(count);
+        length -= static_cast<std::uint64_t>(count);
+    }
+    return true;
+}
+
+// Copies `range` of `from` to the end of `to`. Once the kernel refuses to copy
+// between them, `fallback` is set and the rest goes through a buffer.
+bool copyRange(int from, int to, ByteRange range, bool& fallback) {
+    auto offset = static_cast<loff_t>(range.offset);
+    std::uint64_t length = range.length;
+    while (length > 0 && !fallback) {
+        const ssize_t count = copy_file_range(from, &offset, to, nullptr, length, 0);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Older kernels, other filesystems and some special files can't do it.
+            if (errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP && errno != EINVAL) {
+                return false;
+            }
+            fallback = true;
+        } else if (count == 0) {
+            return false; // the file is shorter than it was
+        } else {
+            length -= static_cast<std::uint64_t>(count);
+        }
+    }
+    return length == 0 || copyThroughBuffer(from, to, static_cast<std::uint64_t>(offset), length);
+}
+
+} // namespace
+
+bool rewriteRanges(const std::filesystem::path& path, const std::vector<ByteRange>& ranges, std::string_view suffix,
+                   std::string& error) {
+    auto tempPath = path;
+    tempPath += ".tmp";
+    const FileDescriptor from{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (from.fd < 0) {
+        error = "unable to read " + path.string() + ": " + std::strerror(errno);
+        return false;
+    }
+    {
+        const FileDescriptor to{open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+        bool copied = to.fd >= 0;
+        bool fallback = false;
+        for (std::size_t i = 0; copied && i < ranges.size(); i++) {
+            copied = copyRange(from.fd, to.fd, ranges[i], fallback);
+        }
+        if (copied && !suffix.empty()) {
+            copied = write(to.fd, suffix.data(), suffix.size()) == static_cast<ssize_t>(suffix.size());
+        }
+        if (!copied) {
+            error = "unable to write " + tempPath.string() + ": " + std::strerror(errno);
+            std::filesystem::remove(tempPath);
+            return false;
+        }
+    }
+    std::error_code renameError;
+    std::filesystem::rename(tempPath, path, renameError);
+    if (renameError) {
+        error = "unable to replace " + path.string() + ": " + renameError.message();
+        return false;
+    }
+    return true;
+}
+
+std::optional<RowDeletion> deleteRows(const std::filesystem::path& path, std::size_t baseRows,
+                                      const std::function<bool(std::string_view row)>& isDeleted, std::string& error) {
+    std::string_view data;
+    void* mapped = nullptr;
+    {
+        const FileDescriptor file{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+        struct stat info{};
+        if (file.fd < 0 || fstat(file.fd, &info) != 0) {
+            error = "unable to read " + path.string() + ": " + std::strerror(errno);
+            return std::nullopt;
+        }
+        if (info.st_size > 0) {
+            mapped = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file.fd, 0);
+            if (mapped == MAP_FAILED) {
+                error = "unable to read " + path.string() + ": " + std::strerror(errno);
+                return std::nullopt;
+            }
+            madvise(mapped, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+            data = {static_cast<const char*>(mapped), static_cast<std::size_t>(info.st_size)};
+        }
+    }
+
+    // The kept rows are collected as ranges, neighbours joined into one, starting
+    // with the header.
+    RowDeletion result;
+    std::vector<ByteRange> ranges;
+    auto keep = [&](std::size_t begin, std::size_t end) {
+        if (!ranges.empty() && ranges.back().offset + ranges.back().length == begin) {
+            ranges.back().length += end - begin;
+        } else {
+            ranges.push_back({begin, end - begin});
+        }
+    };
+    std::size_t position = std::min(data.find('\n'), data.size());
+    position = std::min(position + 1, data.size());
+    keep(0, position);
+    for (std::size_t row = 0; position < data.size(); row++) {
+        const std::size_t newline = data.find('\n', position);
+        const std::size_t end = newline == std::string_view::npos ? data.size() : newline + 1;
+        if (isDeleted(data.substr(position, (newline == std::string_view::npos ? data.size() : newline) - position))) {
+            result.deleted++;
+        } else {
+            keep(position, end);
+            result.keptBaseRows += row < baseRows;
+        }
+        position = end;
+    }
+    // A last row without a newline gets one, so that rows can be appended after it.
+    const bool endsInRow = !ranges.empty() && ranges.back().length > 0 &&
+                           data[ranges.back().offset + ranges.back().length - 1] != '\n';
+    if (mapped != nullptr) {
+        munmap(mapped, data.size());
+    }
+
+    if (result.deleted > 0 && !rewriteRanges(path, ranges, endsInRow ? "\n" : "", error)) {
+        return std::nullopt;
+    }
+    return result;
+}
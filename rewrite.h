@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Rewriting events.csv without some of its rows. The rows that are kept are
+// copied as byte ranges of the old file with copy_file_range, so their bytes
+// stay in the kernel (and are shared rather than copied on filesystems with
+// reflinks); only the row boundaries are looked at in userspace.
+
+struct ByteRange {
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+};
+
+// Replaces the file at `path` with the concatenation of `ranges` of it followed
+// by `suffix`. The new contents are written to a temporary file next to it that
+// is renamed into place. Returns false and sets `error` if that fails.
+bool rewriteRanges(const std::filesystem::path& path, const std::vector<ByteRange>& ranges, std::string_view suffix,
+                   std::string& error);
+
+struct RowDeletion {
+    std::size_t deleted = 0;
+    std::size_t keptBaseRows = 0; // of the first `baseRows` rows
+};
+
+// Rewrites the CSV file at `path` without the rows (after the header) for which
+// `isDeleted` returns true. It gets each row without its newline. The file is
+// left alone if no rows are deleted. `baseRows` is the number of rows at the start
+// of the file that are sorted; the result says how many of them are left. Returns
+// `std::nullopt` and sets `error` if the file can't be read or written.
+std::optional<RowDeletion> deleteRows(const std::filesystem::path& path, std::size_t baseRows,
+                                      const std::function<bool(std::string_view row)>& isDeleted, std::string& error);
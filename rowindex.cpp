@@ -0,0 +1,329 @@
+#include "rowindex.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char indexMagic[8] = {'D', 'A', 'Y', 'S', 'R', 'O', 'W', '1'};
+
+// The fixed part of each block: the offset of its first row and the size of its deltas.
+constexpr std::size_t blockHeaderBytes = sizeof(std::uint64_t) + sizeof(std::uint16_t);
+
+void appendVarint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+std::uint64_t readVarint(const std::string& in, std::size_t& position) {
+    std::uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const auto byte = static_cast<unsigned char>(in[position++]);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+// Closes a file descriptor when it goes out of scope.
+struct FileDescriptor {
+    int fd = -1;
+    ~FileDescriptor() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+bool writeAt(int fd, std::string_view bytes, std::uint64_t offset) {
+    while (!bytes.empty()) {
+        const ssize_t count = pwrite(fd, bytes.data(), bytes.size(), static_cast<off_t>(offset));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes.remove_prefix(static_cast<std::size_t>(count));
+        offset += static_cast<std::uint64_t>(count);
+    }
+    return true;
+}
+
+} // namespace
+
+std::optional<RowIndex> RowIndex::load(const std::filesystem::path& indexPath, const FileStamp& eventsStamp) {
+    std::ifstream file(indexPath, std::ios::binary);
+    const std::string data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    Header header{};
+    if (data.size() < sizeof header) {
+        return std::nullopt;
+    }
+    std::memcpy(&header, data.data(), sizeof header);
+    if (std::memcmp(header.magic, indexMagic, sizeof indexMagic) != 0 || !(header.eventsStamp == eventsStamp) ||
+        header.bytes != eventsStamp.size) {
+        return std::nullopt;
+    }
+
+    // The blocks are taken as they are; only their row counts are checked, which
+    // needs just the last byte of each varint.
+    RowIndex index;
+    index.eventsStamp = eventsStamp;
+    index.bytes = header.bytes;
+    for (std::size_t position = sizeof header; position < data.size();) {
+        if (index.rows % blockRows != 0 || data.size() - position < blockHeaderBytes) {
+            return std::nullopt;
+        }
+        std::uint64_t offset;
+        std::uint16_t size;
+        std::memcpy(&offset, data.data() + position, sizeof offset);
+        std::memcpy(&size, data.data() + position + sizeof offset, sizeof size);
+        position += blockHeaderBytes;
+        if (data.size() - position < size || (size > 0 && static_cast<unsigned char>(data[position + size - 1]) >= 0x80)) {
+            return std::nullopt;
+        }
+        const auto deltaCount = static_cast<std::size_t>(
+            std::count_if(data.begin() + position, data.begin() + position + size, [](char byte) { return static_cast<unsigned char>(byte) < 0x80; }));
+        if (deltaCount >= blockRows) {
+            return std::nullopt;
+        }
+        index.blockOffsets.push_back(offset);
+        index.blockPositions.push_back(static_cast<std::uint32_t>(index.deltas.size()));
+        index.deltas.append(data, position, size);
+        index.rows += deltaCount + 1;
+        position += size;
+    }
+    if (index.rows != header.rows) {
+        return std::nullopt;
+    }
+    if (index.rows > 0) {
+        index.lastOffset = index.getOffset(index.rows - 1);
+        if (index.lastOffset >= index.bytes) {
+            return std::nullopt;
+        }
+    }
+    return index;
+}
+
+std::optional<RowIndex> RowIndex::build(const std::filesystem::path& eventsPath) {
+    const auto stamp = FileStamp::of(eventsPath);
+    const FileDescriptor file{::open(eventsPath.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (!stamp.has_value() || file.fd < 0) {
+        return std::nullopt;
+    }
+    RowIndex index;
+    if (!index.scan(file.fd, 0, stamp->size)) {
+        return std::nullopt;
+    }
+    index.eventsStamp = stamp.value();
+    return index;
+}
+
+std::optional<RowIndex> RowIndex::open(const std::filesystem::path& indexPath, const std::filesystem::path& eventsPath) {
+    const auto stamp = FileStamp::of(eventsPath);
+    if (!stamp.has_value()) {
+        return std::nullopt;
+    }
+    if (auto index = load(indexPath, stamp.value()); index.has_value()) {
+        return index;
+    }
+    auto index = build(eventsPath);
+    if (index.has_value()) {
+        index->save(indexPath, eventsPath); // if it can't be written, it is just built again next time
+    }
+    return index;
+}
+
+std::uint64_t RowIndex::getOffset(std::size_t row) const {
+    const std::size_t block = row / blockRows;
+    std::size_t position = blockPositions[block];
+    std::uint64_t offset = blockOffsets[block];
+    for (std::size_t i = 0; i < row % blockRows; i++) {
+        offset += readVarint(deltas, position);
+    }
+    return offset;
+}
+
+void RowIndex::erase(std::size_t row) {
+    std::vector<std::uint64_t> offsets;
+    offsets.reserve(rows);
+    for (std::size_t block = 0; block < blockOffsets.size(); block++) {
+        std::size_t position = blockPositions[block];
+        offsets.push_back(blockOffsets[block]);
+        const std::size_t end = block + 1 < blockPositions.size() ? blockPositions[block + 1] : deltas.size();
+        while (position < end) {
+            offsets.push_back(offsets.back() + readVarint(deltas, position));
+        }
+    }
+    const std::uint64_t length = getEnd(row) - offsets[row];
+
+    rows = 0;
+    lastOffset = 0;
+    blockOffsets.clear();
+    blockPositions.clear();
+    deltas.clear();
+    for (std::size_t i = 0; i < offsets.size(); i++) {
+        if (i != row) {
+            push(i < row ? offsets[i] : offsets[i] - length);
+        }
+    }
+    bytes -= length;
+}
+
+bool RowIndex::extend(const std::filesystem::path& indexPath, const std::filesystem::path& eventsPath) {
+    const auto stamp = FileStamp::of(eventsPath);
+    if (!stamp.has_value() || stamp->size < bytes) {
+        return false;
+    }
+    if (stamp.value() == eventsStamp) {
+        return true;
+    }
+    const FileDescriptor file{::open(eventsPath.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (file.fd < 0) {
+        return false;
+    }
+
+    // If the file didn't end in a newline, its last row (or the header) went on,
+    // so it is scanned again.
+    std::uint64_t from = bytes;
+    char last = '\n';
+    if (bytes > 0 && pread(file.fd, &last, 1, static_cast<off_t>(bytes - 1)) != 1) {
+        return false;
+    }
+    if (last != '\n') {
+        from = rows > 0 ? lastOffset : 0;
+        if (rows > 0) {
+            pop();
+        }
+    }
+    const std::size_t firstBlock = rows / blockRows; // the first block that changes
+    if (!scan(file.fd, from, stamp->size)) {
+        return false;
+    }
+    eventsStamp = stamp.value();
+
+    // The old header is invalidated before the blocks change, so that an index
+    // cut short halfway through is never taken for a current one.
+    const FileDescriptor out{::open(indexPath.c_str(), O_RDWR | O_CLOEXEC)};
+    if (out.fd < 0) {
+        return false;
+    }
+    Header header{};
+    const std::uint64_t position = sizeof header + firstBlock * blockHeaderBytes +
+                                   (firstBlock < blockPositions.size() ? blockPositions[firstBlock] : deltas.size());
+    if (!writeAt(out.fd, std::string_view(reinterpret_cast<const char*>(&header), sizeof header), 0) ||
+        ftruncate(out.fd, static_cast<off_t>(position)) != 0 || !writeAt(out.fd, encodeBlocks(firstBlock), position)) {
+        return false;
+    }
+    std::memcpy(header.magic, indexMagic, sizeof indexMagic);
+    header.eventsStamp = eventsStamp;
+    header.rows = rows;
+    header.bytes = bytes;
+    return writeAt(out.fd, std::string_view(reinterpret_cast<const char*>(&header), sizeof header), 0);
+}
+
+bool RowIndex::save(const std::filesystem::path& indexPath, const std::filesystem::path& eventsPath) {
+    const auto stamp = FileStamp::of(eventsPath);
+    if (!stamp.has_value() || stamp->size != bytes) {
+        return false;
+    }
+    eventsStamp = stamp.value();
+    Header header{};
+    std::memcpy(header.magic, indexMagic, sizeof indexMagic);
+    header.eventsStamp = eventsStamp;
+    header.rows = rows;
+    header.bytes = bytes;
+
+    auto tempPath = indexPath;
+    tempPath += ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        const std::string blocks = encodeBlocks(0);
+        out.write(blocks.data(), static_cast<std::streamsize>(blocks.size()));
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, indexPath, error);
+    return !error;
+}
+
+void RowIndex::push(std::uint64_t offset) {
+    if (rows % blockRows == 0) {
+        blockOffsets.push_back(offset);
+        blockPositions.push_back(static_cast<std::uint32_t>(deltas.size()));
+    } else {
+        appendVarint(deltas, offset - lastOffset);
+    }
+    lastOffset = offset;
+    rows++;
+}
+
+void RowIndex::pop() {
+    rows--;
+    if (rows % blockRows == 0) {
+        blockOffsets.pop_back();
+        deltas.resize(blockPositions.back());
+        blockPositions.pop_back();
+    } else {
+        // The last delta starts after those of the rows left in the block.
+        std::size_t position = blockPositions.back();
+        for (std::size_t i = 1; i < rows % blockRows; i++) {
+            readVarint(deltas, position);
+        }
+        deltas.resize(position);
+    }
+    lastOffset = rows > 0 ? getOffset(rows - 1) : 0;
+}
+
+bool RowIndex::scan(int fd, std::uint64_t from, std::uint64_t to) {
+    // Every newline but one at the very end starts a row; the header's first
+    // byte does not.
+    if (from > 0 && from < to) {
+        push(from);
+    }
+    std::vector<char> buffer(1 << 20);
+    for (std::uint64_t position = from; position < to;) {
+        const ssize_t count = pread(fd, buffer.data(), std::min<std::uint64_t>(to - position, buffer.size()), static_cast<off_t>(position));
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        const char* end = buffer.data() + count;
+        for (const char* newline = buffer.data();
+             (newline = static_cast<const char*>(std::memchr(newline, '\n', end - newline))) != nullptr; newline++) {
+            const std::uint64_t next = position + static_cast<std::uint64_t>(newline - buffer.data()) + 1;
+            if (next < to) {
+                push(next);
+            }
+        }
+        position += static_cast<std::uint64_t>(count);
+    }
+    bytes = to;
+    return true;
+}
+
+std::string RowIndex::encodeBlocks(std::size_t first) const {
+    std::string out;
+    for (std::size_t block = first; block < blockOffsets.size(); block++) {
+        const std::size_t end = block + 1 < blockPositions.size() ? blockPositions[block + 1] : deltas.size();
+        const auto size = static_cast<std::uint16_t>(end - blockPositions[block]);
+        out.append(reinterpret_cast<const char*>(&blockOffsets[block]), sizeof blockOffsets[block]);
+        out.append(reinterpret_cast<const char*>(&size), sizeof size);
+        out.append(deltas, blockPositions[block], size);
+    }
+    return out;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "filestamp.h"
+
+// A persisted index of where each row of events.csv starts, so that a row can be
+// read (or cut out) by its number without scanning the file up to it. Rows are
+// numbered from 0 after the header, the same as in the errors of loading events.
+//
+// The offsets are kept in blocks of 64 rows, each the absolute offset of its
+// first row and the distance from each row to the next as a varint, which is a
+// byte or two for a typical row:
+//
+//   header | (u64 first offset | u16 size of deltas | varint deltas)*
+//
+// The header records the stamp of events.csv the index was built from, which is
+// how a stale index is detected. Appending rows only rewrites the last block.
+class RowIndex {
+public:
+    static constexpr std::size_t blockRows = 64;
+
+    RowIndex() = default;
+
+    // Reads the index at `indexPath` if it was written for the events file with
+    // the stamp `eventsStamp`. Returns `std::nullopt` if it is missing, stale or
+    // malformed.
+    static std::optional<RowIndex> load(const std::filesystem::path& indexPath, const FileStamp& eventsStamp);
+
+    // Finds the rows of the CSV file at `eventsPath` by scanning it for newlines.
+    static std::optional<RowIndex> build(const std::filesystem::path& eventsPath);
+
+    // Loads the index at `indexPath` for the current `eventsPath`, or builds it
+    // and writes it there if it is missing or stale.
+    static std::optional<RowIndex> open(const std::filesystem::path& indexPath, const std::filesystem::path& eventsPath);
+
+    std::size_t size() const { return rows; }
+
+    // Returns the offset of the first byte of `row`.
+    std::uint64_t getOffset(std::size_t row) const;
+
+    // Returns the offset just past `row` and its newline, which is where the next
+    // row starts.
+    std::uint64_t getEnd(std::size_t row) const { return row + 1 < rows ? getOffset(row + 1) : bytes; }
+
+    // Returns the size of the events file the index covers.
+    std::uint64_t getBytes() const { return bytes; }
+
+    // Drops `row`, moving the rows after it back by its length, as when it is cut
+    // out of the file.
+    void erase(std::size_t row);
+
+    // Picks up the rows appended to `eventsPath` since the index was built and
+    // adds them to the index at `indexPath`, rewriting only its last block.
+    // Returns false if the file did not just grow, in which case the index has to
+    // be built again.
+    bool extend(const std::filesystem::path& indexPath, const std::filesystem::path& eventsPath);
+
+    // Writes the index to `indexPath` for the current contents of `eventsPath`.
+    bool save(const std::filesystem::path& indexPath, const std::filesystem::path& eventsPath);
+
+private:
+    struct Header {
+        char magic[8];
+        FileStamp eventsStamp;
+        std::uint64_t rows;
+        std::uint64_t bytes;
+    };
+
+    // Adds a row starting at `offset`, after all the others.
+    void push(std::uint64_t offset);
+
+    // Drops the last row.
+    void pop();
+
+    // Adds the rows starting in bytes [from, to) of the open file `fd`. `from` is
+    // the start of a row, or 0 for the header.
+    bool scan(int fd, std::uint64_t from, std::uint64_t to);
+
+    // Returns the blocks from `first` on as they are laid out in the file.
+    std::string encodeBlocks(std::size_t first) const;
+
+    FileStamp eventsStamp;
+    std::uint64_t bytes = 0; // of the events file covered
+    std::size_t rows = 0;
+    std::uint64_t lastOffset = 0;             // of the last row
+    std::vector<std::uint64_t> blockOffsets;   // of the first row of each block
+    std::vector<std::uint32_t> blockPositions; // of the deltas of each block in `deltas`
+    std::string deltas;
+};
@@ -0,0 +1,519 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// A fixed set of threads running tasks from a shared queue.
+class WorkerPool {
+public:
+    explicit WorkerPool(std::size_t count) {
+        for (std::size_t i = 0; i < count; i++) {
+            threads.emplace_back([this] { work(); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        ready.notify_one();
+    }
+
+private:
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
+
+struct Connection {
+    int fd = -1;
+    std::string input;
+    std::string output;
+    std::size_t outputSent = 0;            // bytes of `output` already written
+    std::uint64_t nextSequence = 0;        // given to the next request read
+    std::uint64_t nextToSend = 0;          // the response that goes out next
+    std::map<std::uint64_t, std::string> finished; // responses waiting for earlier ones
+    std::size_t inFlight = 0;
+    bool peerClosed = false;
+    std::uint32_t events = 0;              // what epoll is currently asked to report
+
+    std::size_t getPendingOutput() const { return output.size() - outputSent; }
+};
+
+struct Completion {
+    std::uint64_t connection;
+    std::uint64_t sequence;
+    std::string response;
+};
+
+const sigset_t& getShutdownSignals() {
+    static const sigset_t signals = [] {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGINT);
+        sigaddset(&set, SIGTERM);
+        return set;
+    }();
+    return signals;
+}
+
+bool setNonBlocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+}
+
+struct Server::State {
+    Options options;
+    Handler handler;
+
+    int epollFd = -1;
+    int listenFd = -1;
+    int wakeFd = -1;   // eventfd the workers signal when they finish a request
+    int signalFd = -1;
+
+    std::uint64_t nextConnectionId = 1;
+    std::unordered_map<std::uint64_t, Connection> connections;
+
+    std::mutex completionMutex;
+    std::vector<Completion> completions;
+
+    WorkerPool* workers = nullptr;
+
+    ~State() {
+        for (auto& [id, connection] : connections) {
+            close(connection.fd);
+        }
+        for (int fd : {epollFd, listenFd, wakeFd, signalFd}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool setUp();
+    void acceptConnections();
+    void readRequests(std::uint64_t id, Connection& connection);
+    // Hands the complete frames in the input buffer to the workers, up to the
+    // in-flight limit.
+    void dispatchRequests(std::uint64_t id, Connection& connection);
+    void deliverCompletions();
+    void writeResponses(Connection& connection);
+    // Updates what epoll reports for the connection, or closes it when it is done.
+    // Returns false if the connection was closed.
+    bool updateInterest(std::uint64_t id, Connection& connection);
+    void closeConnection(std::uint64_t id);
+};
+
+Server::Server(Options options, Handler handler) : state(std::make_unique<State>()) {
+    state->options = std::move(options);
+    state->handler = std::move(handler);
+
+    // SIGINT and SIGTERM are taken through the loop, so that it can shut down
+    // cleanly. They have to be blocked before any other thread starts, or the
+    // kernel may deliver them to a thread that still has them unblocked.
+    pthread_sigmask(SIG_BLOCK, &getShutdownSignals(), nullptr);
+}
+
+Server::~Server() = default;
+
+bool Server::State::setUp() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    const std::string path = options.socketPath.string();
+    if (path.size() >= sizeof address.sun_path) {
+        std::cerr << "Socket path is too long: " << path << std::endl;
+        return false;
+    }
+    std::strncpy(address.sun_path, path.c_str(), sizeof address.sun_path - 1);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path.c_str()); // a socket left behind by a daemon that didn't exit cleanly
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0 ||
+        chmod(path.c_str(), 0600) != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        std::cerr << "Unable to listen on " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    signalFd = signalfd(-1, &getShutdownSignals(), SFD_NONBLOCK | SFD_CLOEXEC);
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (signalFd < 0 || wakeFd < 0 || epollFd < 0) {
+        std::cerr << "Unable to set up the event loop: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Connections are keyed by id in the event data; ids 0 and below are reserved.
+    auto add = [&](int fd, std::uint64_t key) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = key;
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+    };
+    return add(listenFd, 0) && add(wakeFd, UINT64_MAX) && add(signalFd, UINT64_MAX - 1);
+}
+
+bool Server::run() {
+    auto& s = *state;
+    if (!s.setUp()) {
+        return false;
+    }
+
+    // The pool is declared after the state it refers to and destroyed first, so
+    // no worker can finish a request after the loop is gone.
+    WorkerPool workers(s.options.workers);
+    s.workers = &workers;
+    std::vector<epoll_event> events(256);
+    bool running = true;
+    while (running) {
+        const int count = epoll_wait(s.epollFd, events.data(), static_cast<int>(events.size()), -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            const std::uint64_t key = events[i].data.u64;
+            if (key == 0) {
+                s.acceptConnections();
+            } else if (key == UINT64_MAX) {
+                s.deliverCompletions();
+            } else if (key == UINT64_MAX - 1) {
+                running = false;
+            } else {
+                auto found = s.connections.find(key);
+                if (found == s.connections.end()) {
+                    continue; // closed earlier in this batch
+                }
+                auto& connection = found->second;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    s.closeConnection(key);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    s.readRequests(key, connection);
+                }
+                if (events[i].events & EPOLLOUT) {
+                    s.writeResponses(connection);
+                }
+                s.updateInterest(key, connection);
+            }
+        }
+    }
+    s.workers = nullptr;
+    unlink(s.options.socketPath.c_str());
+    return true;
+}
+
+void Server::State::acceptConnections() {
+    while (true) {
+        const int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return; // EAGAIN: no more pending connections
+        }
+        const std::uint64_t id = nextConnectionId++;
+        auto& connection = connections[id];
+        connection.fd = fd;
+        connection.events = EPOLLIN | EPOLLRDHUP;
+        epoll_event event{};
+        event.events = connection.events;
+        event.data.u64 = id;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            closeConnection(id);
+        }
+    }
+}
+
+void Server::State::readRequests(std::uint64_t id, Connection& connection) {
+    char buffer[64 * 1024];
+    while (connection.inFlight < options.maxInFlight && connection.getPendingOutput() < options.highWatermark) {
+        const ssize_t length = read(connection.fd, buffer, sizeof buffer);
+        if (length > 0) {
+            connection.input.append(buffer, length);
+        } else if (length == 0) {
+            connection.peerClosed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            break; // EAGAIN, or an error that EPOLLERR will report
+        }
+
+        dispatchRequests(id, connection);
+        if (connection.peerClosed) {
+            break;
+        }
+    }
+}
+
+void Server::State::dispatchRequests(std::uint64_t id, Connection& connection) {
+    std::string request;
+    std::size_t taken = 0;
+    while (connection.inFlight < options.maxInFlight && takeFrame(connection.input, taken, request)) {
+        const std::uint64_t sequence = connection.nextSequence++;
+        connection.inFlight++;
+        workers->submit([this, id, sequence, request = std::move(request)]() mutable {
+            std::string response = handler(request);
+            {
+                std::lock_guard lock(completionMutex);
+                completions.push_back({id, sequence, std::move(response)});
+            }
+            const std::uint64_t one = 1;
+            [[maybe_unused]] auto written = write(wakeFd, &one, sizeof one);
+        });
+    }
+    connection.input.erase(0, taken);
+    if (connection.input.size() >= 4) {
+        const auto* bytes = reinterpret_cast<const unsigned char*>(connection.input.data());
+        const std::uint32_t size = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<std::uint32_t>(bytes[3]) << 24);
+        if (size > options.maxFrameSize) {
+            connection.peerClosed = true; // refuse the request and stop reading
+            connection.input.clear();
+        }
+    }
+}
+
+void Server::State::deliverCompletions() {
+    std::uint64_t count = 0;
+    [[maybe_unused]] auto drained = read(wakeFd, &count, sizeof count);
+
+    std::vector<Completion> ready;
+    {
+        std::lock_guard lock(completionMutex);
+        ready.swap(completions);
+    }
+    for (auto& completion : ready) {
+        auto found = connections.find(completion.connection);
+        if (found == connections.end()) {
+            continue; // the client went away while its request was running
+        }
+        auto& connection = found->second;
+        connection.inFlight--;
+        connection.finished.emplace(completion.sequence, std::move(completion.response));
+        if (connection.getPendingOutput() < options.highWatermark) {
+            dispatchRequests(completion.connection, connection); // frames left waiting at the limit
+        }
+
+        // Responses go out in request order.
+        for (auto next = connection.finished.begin();
+             next != connection.finished.end() && next->first == connection.nextToSend;
+             next = connection.finished.erase(next)) {
+            appendFrame(connection.output, next->second);
+            connection.nextToSend++;
+        }
+        writeResponses(connection);
+    }
+    for (auto& completion : ready) {
+        auto found = connections.find(completion.connection);
+        if (found != connections.end()) {
+            updateInterest(found->first, found->second);
+        }
+    }
+}
+
+void Server::State::writeResponses(Connection& connection) {
+    while (connection.getPendingOutput() > 0) {
+        const ssize_t written = send(connection.fd, connection.output.data() + connection.outputSent,
+                                     connection.getPendingOutput(), MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // EAGAIN: wait for EPOLLOUT
+        }
+        connection.outputSent += written;
+    }
+    if (connection.outputSent == connection.output.size()) {
+        connection.output.clear();
+        connection.outputSent = 0;
+    } else if (connection.outputSent > (1 << 20)) {
+        connection.output.erase(0, connection.outputSent);
+        connection.outputSent = 0;
+    }
+}
+
+bool Server::State::updateInterest(std::uint64_t id, Connection& connection) {
+    const std::size_t pending = connection.getPendingOutput();
+    if (connection.peerClosed && connection.inFlight == 0 && pending == 0) {
+        closeConnection(id);
+        return false;
+    }
+
+    // Read while the client is keeping up; the watermarks keep the connection
+    // from flapping between the two states on every write.
+    const bool reading = !connection.peerClosed && connection.inFlight < options.maxInFlight &&
+                         (pending < options.lowWatermark ||
+                          ((connection.events & EPOLLIN) && pending < options.highWatermark));
+    std::uint32_t wanted = EPOLLRDHUP;
+    if (reading) {
+        wanted |= EPOLLIN;
+    }
+    if (pending > 0) {
+        wanted |= EPOLLOUT;
+    }
+    if (wanted != connection.events) {
+        epoll_event event{};
+        event.events = wanted;
+        event.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = wanted;
+    }
+    return true;
+}
+
+void Server::State::closeConnection(std::uint64_t id) {
+    auto found = connections.find(id);
+    if (found == connections.end()) {
+        return;
+    }
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, found->second.fd, nullptr);
+    close(found->second.fd);
+    connections.erase(found);
+}
+
+void appendFrame(std::string& buffer, const std::string& payload) {
+    const auto size = static_cast<std::uint32_t>(payload.size());
+    const char header[4] = {
+        static_cast<char>(size & 0xff), static_cast<char>((size >> 8) & 0xff),
+        static_cast<char>((size >> 16) & 0xff), static_cast<char>((size >> 24) & 0xff)};
+    buffer.append(header, sizeof header);
+    buffer.append(payload);
+}
+
+bool takeFrame(const std::string& buffer, std::size_t& offset, std::string& payload) {
+    if (buffer.size() - offset < 4) {
+        return false;
+    }
+    const auto* bytes = reinterpret_cast<const unsigned char*>(buffer.data() + offset);
+    const std::uint32_t size = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<std::uint32_t>(bytes[3]) << 24);
+    if (buffer.size() - offset - 4 < size) {
+        return false;
+    }
+    payload.assign(buffer, offset + 4, size);
+    offset += 4 + static_cast<std::size_t>(size);
+    return true;
+}
+
+int connectToServer(const std::filesystem::path& socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    const std::string path = socketPath.string();
+    if (path.size() >= sizeof address.sun_path) {
+        return -1;
+    }
+    std::strncpy(address.sun_path, path.c_str(), sizeof address.sun_path - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool exchangeFrames(int fd, const std::vector<std::string>& requests,
+                    const std::function<bool(const std::string& response)>& onResponse) {
+    std::string output;
+    for (const auto& request : requests) {
+        appendFrame(output, request);
+    }
+    if (!setNonBlocking(fd)) {
+        return false;
+    }
+
+    std::size_t sent = 0;
+    std::size_t received = 0;
+    std::string input;
+    std::string response;
+    char buffer[64 * 1024];
+    while (received < requests.size()) {
+        pollfd descriptor{fd, static_cast<short>(POLLIN | (sent < output.size() ? POLLOUT : 0)), 0};
+        if (poll(&descriptor, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (descriptor.revents & POLLOUT) {
+            const ssize_t written = send(fd, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+            if (written < 0 && errno != EAGAIN && errno != EINTR) {
+                return false;
+            }
+            sent += std::max<ssize_t>(written, 0);
+        }
+        if (descriptor.revents & (POLLIN | POLLHUP | POLLERR)) {
+            const ssize_t length = read(fd, buffer, sizeof buffer);
+            if (length == 0 || (length < 0 && errno != EAGAIN && errno != EINTR)) {
+                return false;
+            }
+            input.append(buffer, std::max<ssize_t>(length, 0));
+            std::size_t taken = 0;
+            while (received < requests.size() && takeFrame(input, taken, response)) {
+                received++;
+                if (!onResponse(response)) {
+                    return false;
+                }
+            }
+            input.erase(0, taken);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The days daemon: a single epoll event loop that owns every client connection
+// on a Unix socket, and a pool of worker threads that executes the requests.
+//
+// Requests and responses are frames: a 4-byte little-endian payload length
+// followed by the payload. The loop only moves bytes: it reads frames into a
+// per-connection input buffer, hands each complete request to the workers and
+// writes the responses back in the order the requests arrived.
+//
+// Backpressure: a connection stops being read while it has too many requests
+// in flight or too much unsent output, and is read again once the client has
+// caught up, so one slow client can't make the daemon buffer without bound.
+class Server {
+public:
+    // Executes one request payload and returns the response payload. Called
+    // from the worker threads, so it has to be thread safe.
+    using Handler = std::function<std::string(const std::string& request)>;
+
+    struct Options {
+        std::filesystem::path socketPath;
+        std::size_t workers = 4;
+        std::size_t maxInFlight = 64;              // requests per connection
+        std::size_t highWatermark = 1 << 20;       // stop reading above this much unsent output
+        std::size_t lowWatermark = 1 << 18;        // resume reading below this
+        std::uint32_t maxFrameSize = 16 << 20;     // larger frames close the connection
+    };
+
+    // Blocks SIGINT and SIGTERM in the calling thread, so the server has to be
+    // created before any threads that should inherit that.
+    Server(Options options, Handler handler);
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Listens on the socket and serves clients until SIGINT or SIGTERM.
+    // Returns false if the socket can't be set up.
+    bool run();
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+// Appends a frame holding `payload` to `buffer`.
+void appendFrame(std::string& buffer, const std::string& payload);
+
+// If `buffer` has a complete frame at `offset`, copies its payload to `payload`,
+// moves `offset` past the frame and returns true. The caller drops the frames
+// it has taken from the buffer once it is done with a read, rather than one
+// frame at a time, which would move the rest of a long pipeline for each one.
+bool takeFrame(const std::string& buffer, std::size_t& offset, std::string& payload);
+
+// Connects to the daemon listening on `socketPath`. Returns the socket, or -1.
+int connectToServer(const std::filesystem::path& socketPath);
+
+// Sends each of `requests` as a frame on the socket `fd` and passes the
+// response frames to `onResponse` as they arrive, until there has been one for
+// every request. The requests are written while responses are read, so a long
+// pipeline can't stall on the daemon's backpressure. Returns false if the
+// connection fails or `onResponse` returns false.
+bool exchangeFrames(int fd, const std::vector<std::string>& requests,
+                    const std::function<bool(const std::string& response)>& onResponse);
@@ -0,0 +1,311 @@
+#include "shards.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <latch>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+bool isEarlier(const Event& a, const Event& b) {
+    return getMinuteNumber(a) < getMinuteNumber(b);
+}
+
+bool isEarlierDay(const Event& a, const Event& b) {
+    return std::chrono::sys_days{a.getTimestamp()} < std::chrono::sys_days{b.getTimestamp()};
+}
+
+}
+
+struct ShardedEvents::Shard {
+    std::thread thread;
+
+    // The mailbox is the only thing shared with other threads.
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void(Shard&)>> mailbox;
+    bool stopping = false;
+
+    // Owned by the shard's thread. The events are kept in date and time order.
+    std::vector<Event> events;
+    std::optional<EventColumns> columns; // built on the first scan after a change
+    std::uint64_t version = 0;           // counts the changes to `events`
+
+    void changed() {
+        columns.reset();
+        version++;
+    }
+
+    const EventColumns& getColumns() {
+        if (!columns.has_value()) {
+            columns = EventColumns::of(events);
+        }
+        return columns.value();
+    }
+
+    // Returns true if no event in the shard can be in [`low`, `high`].
+    bool isOutside(std::int32_t low, std::int32_t high) const {
+        return events.empty() || events.back().getDayNumber() < low ||
+               events.front().getDayNumber() > high;
+    }
+
+    void post(std::function<void(Shard&)> task) {
+        {
+            std::lock_guard lock(mutex);
+            mailbox.push_back(std::move(task));
+        }
+        ready.notify_one();
+    }
+
+    void run() {
+        while (true) {
+            std::function<void(Shard&)> task;
+            {
+                std::unique_lock lock(mutex);
+                ready.wait(lock, [this] { return stopping || !mailbox.empty(); });
+                if (mailbox.empty()) {
+                    return;
+                }
+                task = std::move(mailbox.front());
+                mailbox.pop_front();
+            }
+            task(*this);
+        }
+    }
+};
+
+std::size_t ShardedEvents::Layout::getShardOf(std::int32_t day) const {
+    const auto next = std::upper_bound(firstDays.begin() + 1, firstDays.end(), day);
+    return static_cast<std::size_t>(next - firstDays.begin()) - 1;
+}
+
+ShardedEvents::ShardedEvents(std::size_t shardCount) {
+    const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (std::size_t i = 0; i < std::max<std::size_t>(shardCount, 1); i++) {
+        auto shard = std::make_unique<Shard>();
+        shard->thread = std::thread([shard = shard.get()] { shard->run(); });
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(i % cores, &cpus);
+        pthread_setaffinity_np(shard->thread.native_handle(), sizeof cpus, &cpus);
+        shards.push_back(std::move(shard));
+    }
+
+    auto empty = std::make_shared<Layout>();
+    empty->firstDays.assign(shards.size(), INT32_MIN);
+    layout.store(std::move(empty));
+}
+
+ShardedEvents::~ShardedEvents() {
+    for (auto& shard : shards) {
+        {
+            std::lock_guard lock(shard->mutex);
+            shard->stopping = true;
+        }
+        shard->ready.notify_one();
+        shard->thread.join();
+    }
+}
+
+void ShardedEvents::scatter(const std::function<void(std::size_t index, Shard& shard)>& task) {
+    std::latch done(static_cast<std::ptrdiff_t>(shards.size()));
+    for (std::size_t i = 0; i < shards.size(); i++) {
+        shards[i]->post([&task, &done, i](Shard& shard) {
+            task(i, shard);
+            done.count_down();
+        });
+    }
+    done.wait();
+}
+
+void ShardedEvents::load(std::vector<Event> events) {
+    std::stable_sort(events.begin(), events.end(), isEarlier);
+
+    // Cut at about equal counts, moving each cut past the events of the same day
+    // so that a day never spans two shards.
+    auto next = std::make_shared<Layout>();
+    std::vector<std::size_t> cuts{0};
+    for (std::size_t i = 1; i < shards.size(); i++) {
+        std::size_t cut = std::max(events.size() * i / shards.size(), cuts.back());
+        while (cut > cuts.back() && cut < events.size() && !isEarlierDay(events[cut - 1], events[cut])) {
+            cut++;
+        }
+        cuts.push_back(cut);
+    }
+    cuts.push_back(events.size());
+    next->firstDays.push_back(INT32_MIN);
+    for (std::size_t i = 1; i < shards.size(); i++) {
+        // An empty shard starts where the next one does, so it never gets any events.
+        next->firstDays.push_back(cuts[i] < events.size() ? events[cuts[i]].getDayNumber() : INT32_MAX);
+    }
+
+    scatter([&](std::size_t index, Shard& shard) {
+        shard.events.assign(std::make_move_iterator(events.begin() + static_cast<std::ptrdiff_t>(cuts[index])),
+                            std::make_move_iterator(events.begin() + static_cast<std::ptrdiff_t>(cuts[index + 1])));
+        shard.changed();
+    });
+    layout.store(std::move(next));
+}
+
+std::optional<std::vector<Event>> ShardedEvents::select(const QueryPlan& plan, const QueryControl& control) {
+    const auto& shape = plan.shape;
+    const std::int32_t low = shape.has_value() ? shape->low.value_or(INT32_MIN) : INT32_MIN;
+    const std::int32_t high = shape.has_value() ? shape->high.value_or(INT32_MAX) : INT32_MAX;
+
+    std::vector<std::vector<Event>> results(shards.size());
+    std::atomic<bool> stopped{false};
+    scatter([&](std::size_t index, Shard& shard) {
+        if (shard.isOutside(low, high)) {
+            return;
+        }
+        const auto rows = scan(shard.getColumns(), plan, control);
+        if (!rows.has_value()) {
+            stopped = true;
+            return;
+        }
+        results[index].reserve(rows->size());
+        for (auto row : rows.value()) {
+            results[index].push_back(shard.events[row]);
+        }
+    });
+    if (stopped) {
+        return std::nullopt;
+    }
+
+    std::vector<Event> selected;
+    std::size_t total = 0;
+    for (const auto& result : results) {
+        total += result.size();
+    }
+    selected.reserve(total);
+    for (auto& result : results) {
+        std::move(result.begin(), result.end(), std::back_inserter(selected));
+    }
+    return selected;
+}
+
+std::optional<ShardedEvents::SharedSelection> ShardedEvents::selectShared(const std::vector<const QueryPlan*>& plans,
+                                                                           const QueryControl& control) {
+    // Each shard sends the events that match any of the plans, with the sets
+    // renumbered into positions among them; the sets are joined in shard order.
+    std::vector<SharedSelection> results(shards.size());
+    std::atomic<bool> stopped{false};
+    scatter([&](std::size_t index, Shard& shard) {
+        auto sets = scanShared(shard.getColumns(), plans, control);
+        if (!sets.has_value()) {
+            stopped = true;
+            return;
+        }
+        std::vector<std::uint32_t> positions(shard.events.size(), UINT32_MAX);
+        for (const auto& set : sets.value()) {
+            for (auto row : set) {
+                positions[row] = 0;
+            }
+        }
+        auto& result = results[index];
+        for (std::size_t row = 0; row < positions.size(); row++) {
+            if (positions[row] != UINT32_MAX) {
+                positions[row] = static_cast<std::uint32_t>(result.events.size());
+                result.events.push_back(shard.events[row]);
+            }
+        }
+        for (auto& set : sets.value()) {
+            for (auto& row : set) {
+                row = positions[row];
+            }
+        }
+        result.rowSets = std::move(sets.value());
+    });
+    if (stopped) {
+        return std::nullopt;
+    }
+
+    SharedSelection selection;
+    selection.rowSets.resize(plans.size());
+    for (auto& result : results) {
+        const auto offset = static_cast<std::uint32_t>(selection.events.size());
+        for (std::size_t i = 0; i < result.rowSets.size(); i++) {
+            for (auto position : result.rowSets[i]) {
+                selection.rowSets[i].push_back(offset + position);
+            }
+        }
+        std::move(result.events.begin(), result.events.end(), std::back_inserter(selection.events));
+    }
+    return selection;
+}
+
+void ShardedEvents::add(Event event) {
+    const std::size_t index = layout.load()->getShardOf(event.getDayNumber());
+    shards[index]->post([event = std::move(event)](Shard& shard) mutable {
+        const auto position = std::upper_bound(shard.events.begin(), shard.events.end(), event, isEarlier);
+        shard.events.insert(position, std::move(event));
+        shard.changed();
+    });
+}
+
+std::optional<std::size_t> ShardedEvents::remove(const Filter& filter, const QueryControl& control) {
+    // Every shard scans first; only if none of them was stopped do they delete,
+    // so a timeout can't leave the removal half done.
+    std::vector<std::vector<std::uint32_t>> matches(shards.size());
+    std::vector<std::uint64_t> versions(shards.size());
+    std::atomic<bool> stopped{false};
+    scatter([&](std::size_t index, Shard& shard) {
+        auto rows = scan(shard.getColumns(), filter, control);
+        if (!rows.has_value()) {
+            stopped = true;
+            return;
+        }
+        matches[index] = std::move(rows.value());
+        versions[index] = shard.version;
+    });
+    if (stopped) {
+        return std::nullopt;
+    }
+
+    std::atomic<std::size_t> removed{0};
+    scatter([&](std::size_t index, Shard& shard) {
+        auto& rows = matches[index];
+        if (shard.version != versions[index]) {
+            // Something was added in between, so the rows have moved. The query
+            // was already allowed to finish, so this scan runs without a deadline.
+            rows = scan(shard.getColumns(), filter).value();
+        }
+        if (rows.empty()) {
+            return;
+        }
+        // Starting at the first match keeps every move from assigning an event to itself.
+        std::size_t kept = rows.front();
+        auto match = rows.begin();
+        for (std::size_t row = rows.front(); row < shard.events.size(); row++) {
+            if (match != rows.end() && *match == row) {
+                ++match;
+            } else {
+                shard.events[kept++] = std::move(shard.events[row]);
+            }
+        }
+        shard.events.erase(shard.events.begin() + static_cast<std::ptrdiff_t>(kept), shard.events.end());
+        shard.changed();
+        removed += rows.size();
+    });
+    return removed.load();
+}
+
+std::vector<Event> ShardedEvents::getEvents() {
+    std::vector<std::vector<Event>> copies(shards.size());
+    scatter([&](std::size_t index, Shard& shard) { copies[index] = shard.events; });
+
+    std::vector<Event> events;
+    for (auto& copy : copies) {
+        std::move(copy.begin(), copy.end(), std::back_inserter(events));
+    }
+    return events;
+}
+
+void ShardedEvents::visit(const std::function<void(std::size_t index, const std::vector<Event>& events)>& visit) {
+    scatter([&](std::size_t index, Shard& shard) { visit(index, shard.events); });
+}
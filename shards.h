@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "event.h"
+#include "filter.h"
+#include "kernels.h"
+#include "querycontrol.h"
+
+// The events partitioned by date range across shards, for `days serve --shards N`.
+//
+// Each shard is a thread pinned to a core that owns the events of its date
+// range outright: nothing else touches them, so there are no locks on the data.
+// Other threads talk to a shard by posting tasks to its mailbox. Queries are
+// scattered to every shard, which skips them outright when its date range
+// doesn't overlap the query's, and the results are gathered in shard order,
+// which is date order.
+class ShardedEvents {
+public:
+    explicit ShardedEvents(std::size_t shardCount);
+    ~ShardedEvents();
+
+    ShardedEvents(const ShardedEvents&) = delete;
+    ShardedEvents& operator=(const ShardedEvents&) = delete;
+
+    // Replaces all events, splitting them into date ranges with about the same
+    // number of events each.
+    void load(std::vector<Event> events);
+
+    // Returns the events that match the filter of `plan` in date order, or
+    // `std::nullopt` if `control` stopped the query.
+    std::optional<std::vector<Event>> select(const QueryPlan& plan, const QueryControl& control);
+
+    // The events that match any of several queries, in date order, and the
+    // positions among them of the events that match each query.
+    struct SharedSelection {
+        std::vector<Event> events;
+        std::vector<std::vector<std::uint32_t>> rowSets;
+    };
+
+    // Runs all of `plans` in one shared scan of each shard (see `scanShared`).
+    // Returns `std::nullopt` if `control` stopped the queries.
+    std::optional<SharedSelection> selectShared(const std::vector<const QueryPlan*>& plans, const QueryControl& control);
+
+    // Adds `event` to the shard that owns its date.
+    void add(Event event);
+
+    // Removes the events that match `filter` and returns how many there were, or
+    // `std::nullopt` if `control` stopped the query before anything was removed.
+    std::optional<std::size_t> remove(const Filter& filter, const QueryControl& control);
+
+    // Returns a copy of all events in date order.
+    std::vector<Event> getEvents();
+
+    // Runs `visit` with the events of every shard, each on its shard's thread,
+    // and waits for all of them. The events can't be kept after `visit` returns.
+    void visit(const std::function<void(std::size_t index, const std::vector<Event>& events)>& visit);
+
+    std::size_t getShardCount() const { return shards.size(); }
+
+private:
+    struct Shard;
+
+    // Where each shard's date range starts, for routing added events. Shard `i`
+    // owns the days from `firstDays[i]` up to `firstDays[i + 1]`; the first and
+    // last shards are open ended. Replaced as a whole by `load`, so readers never
+    // see it change.
+    struct Layout {
+        std::vector<std::int32_t> firstDays;
+
+        std::size_t getShardOf(std::int32_t day) const;
+    };
+
+    // Runs `task` on every shard, on the shard's own thread, and waits for all of them.
+    void scatter(const std::function<void(std::size_t index, Shard& shard)>& task);
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<std::shared_ptr<const Layout>> layout;
+};
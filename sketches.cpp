@@ -0,0 +1,176 @@
+#include "sketches.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+std::uint64_t getSketchHash(std::string_view text) {
+    // FNV-1a, finished with the SplitMix64 mixer so that every bit depends on every byte.
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 0x100000001b3;
+    }
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
+    return hash ^ (hash >> 31);
+}
+
+void HyperLogLog::add(std::uint64_t hash) {
+    const std::size_t index = hash >> (64 - precision);
+    const std::uint64_t rest = hash << precision;
+    const auto rank = static_cast<std::uint8_t>(rest == 0 ? 64 - precision + 1 : std::countl_zero(rest) + 1);
+    registers[index] = std::max(registers[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    for (std::size_t i = 0; i < registers.size(); i++) {
+        registers[i] = std::max(registers[i], other.registers[i]);
+    }
+}
+
+double HyperLogLog::estimate() const {
+    const double m = static_cast<double>(registers.size());
+    double sum = 0;
+    std::size_t zeros = 0;
+    for (auto rank : registers) {
+        sum += std::ldexp(1.0, -rank);
+        zeros += rank == 0;
+    }
+    const double alpha = 0.7213 / (1 + 1.079 / m);
+    const double estimate = alpha * m * m / sum;
+    // Small counts leave registers empty, and counting those is more accurate.
+    if (estimate <= 2.5 * m && zeros > 0) {
+        return m * std::log(m / static_cast<double>(zeros));
+    }
+    return estimate;
+}
+
+void CountMinSketch::add(std::uint64_t hash, std::uint32_t count) {
+    // The rows hash with h1 + i * h2, which is as good as independent hashes.
+    const auto h1 = static_cast<std::uint32_t>(hash);
+    const auto h2 = static_cast<std::uint32_t>(hash >> 32) | 1;
+    for (std::size_t row = 0; row < depth; row++) {
+        auto& counter = counters[row * width + (h1 + row * h2) % width];
+        counter = counter > std::numeric_limits<std::uint32_t>::max() - count ? std::numeric_limits<std::uint32_t>::max() : counter + count;
+    }
+}
+
+std::uint32_t CountMinSketch::estimate(std::uint64_t hash) const {
+    const auto h1 = static_cast<std::uint32_t>(hash);
+    const auto h2 = static_cast<std::uint32_t>(hash >> 32) | 1;
+    std::uint32_t estimate = std::numeric_limits<std::uint32_t>::max();
+    for (std::size_t row = 0; row < depth; row++) {
+        estimate = std::min(estimate, counters[row * width + (h1 + row * h2) % width]);
+    }
+    return estimate;
+}
+
+void CountMinSketch::merge(const CountMinSketch& other) {
+    for (std::size_t i = 0; i < counters.size(); i++) {
+        counters[i] = counters[i] > std::numeric_limits<std::uint32_t>::max() - other.counters[i]
+                          ? std::numeric_limits<std::uint32_t>::max()
+                          : counters[i] + other.counters[i];
+    }
+}
+
+void TopTerms::add(std::string_view term) {
+    const auto hash = getSketchHash(term);
+    sketch.add(hash);
+    offer(std::string(term), sketch.estimate(hash));
+}
+
+void TopTerms::offer(const std::string& term, std::uint32_t count) {
+    const auto isLower = std::greater<>{};
+    if (const auto found = candidates.find(term); found != candidates.end()) {
+        found->second = count;
+        return;
+    }
+    if (candidates.size() < capacity) {
+        candidates.emplace(term, count);
+        heap.emplace_back(count, term);
+        std::push_heap(heap.begin(), heap.end(), isLower);
+        return;
+    }
+    while (candidates.at(heap.front().second) != heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end(), isLower);
+        heap.back().first = candidates.at(heap.back().second);
+        std::push_heap(heap.begin(), heap.end(), isLower);
+    }
+    if (count <= heap.front().first) {
+        return;
+    }
+    std::pop_heap(heap.begin(), heap.end(), isLower);
+    candidates.erase(heap.back().second);
+    heap.back() = {count, term};
+    candidates.emplace(term, count);
+    std::push_heap(heap.begin(), heap.end(), isLower);
+}
+
+void TopTerms::merge(const TopTerms& other) {
+    sketch.merge(other.sketch);
+    std::vector<std::string> terms;
+    for (const auto& [term, count] : candidates) {
+        terms.push_back(term);
+    }
+    for (const auto& [term, count] : other.candidates) {
+        if (!candidates.contains(term)) {
+            terms.push_back(term);
+        }
+    }
+    candidates.clear();
+    heap.clear();
+    for (const auto& term : terms) {
+        offer(term, sketch.estimate(getSketchHash(term)));
+    }
+}
+
+std::vector<std::pair<std::string, std::uint32_t>> TopTerms::getTop(std::size_t limit) const {
+    std::vector<std::pair<std::string, std::uint32_t>> top;
+    for (const auto& [term, count] : candidates) {
+        top.emplace_back(term, sketch.estimate(getSketchHash(term)));
+    }
+    std::sort(top.begin(), top.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    top.resize(std::min(top.size(), limit));
+    return top;
+}
+
+void DescriptionSketch::add(std::string_view description) {
+    count++;
+    distinct.add(getSketchHash(description));
+
+    // Words are runs of letters and digits, lowercased; bytes of UTF-8 sequences
+    // count as letters, so that words in other scripts are kept whole.
+    std::string previous;
+    std::string word;
+    auto endWord = [&]() {
+        if (word.empty()) {
+            return;
+        }
+        words.add(word);
+        if (!previous.empty()) {
+            phrases.add(previous + " " + word);
+        }
+        previous = std::move(word);
+        word.clear();
+    };
+    for (unsigned char c : description) {
+        if (std::isalnum(c) || c >= 0x80) {
+            word += static_cast<char>(std::tolower(c));
+        } else {
+            endWord();
+        }
+    }
+    endWord();
+}
+
+void DescriptionSketch::merge(const DescriptionSketch& other) {
+    count += other.count;
+    distinct.merge(other.distinct);
+    words.merge(other.words);
+    phrases.merge(other.phrases);
+}
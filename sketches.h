@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Fixed-size summaries of a stream of descriptions for `stats --approx`. Each
+// one is built in a single pass, and two of them built over different parts of
+// the events (threads, shards) merge into the summary of all of them.
+
+// Returns a well mixed 64-bit hash of `text`.
+std::uint64_t getSketchHash(std::string_view text);
+
+// Estimates the number of distinct values with about 0.8% standard error in
+// 16 KiB: each value's hash picks a register by its first bits, which keeps
+// the longest run of leading zeros seen in the rest.
+class HyperLogLog {
+public:
+    static constexpr int precision = 14;
+
+    void add(std::uint64_t hash);
+    void merge(const HyperLogLog& other);
+    double estimate() const;
+
+private:
+    std::array<std::uint8_t, std::size_t{1} << precision> registers{};
+};
+
+// Estimates how often each value occurs, never below the true count: every value
+// increments one counter in each row, and its estimate is the smallest of them.
+class CountMinSketch {
+public:
+    static constexpr std::size_t depth = 4;
+    static constexpr std::size_t width = 4096;
+
+    void add(std::uint64_t hash, std::uint32_t count = 1);
+    std::uint32_t estimate(std::uint64_t hash) const;
+    void merge(const CountMinSketch& other);
+
+private:
+    std::vector<std::uint32_t> counters = std::vector<std::uint32_t>(depth * width);
+};
+
+// The most frequent terms of a stream: a count-min sketch counts every term, and
+// a min-heap keeps the `capacity` terms with the highest estimates seen so far.
+class TopTerms {
+public:
+    explicit TopTerms(std::size_t capacity) : capacity(capacity) {}
+
+    void add(std::string_view term);
+    void merge(const TopTerms& other);
+
+    // Returns at most `limit` terms with their estimated counts, most frequent first.
+    std::vector<std::pair<std::string, std::uint32_t>> getTop(std::size_t limit) const;
+
+private:
+    // Offers `term` with its current estimate to the candidates.
+    void offer(const std::string& term, std::uint32_t count);
+
+    std::size_t capacity;
+    CountMinSketch sketch;
+    // The candidates by term, and a min-heap of them by count. An entry in the
+    // heap can be behind the count in `candidates`; it is brought up to date
+    // when it reaches the top, since counts only grow.
+    std::unordered_map<std::string, std::uint32_t> candidates;
+    std::vector<std::pair<std::uint32_t, std::string>> heap;
+};
+
+// The approximate statistics of the descriptions: how many distinct ones there
+// are, and the most frequent words and two-word phrases in them.
+class DescriptionSketch {
+public:
+    void add(std::string_view description);
+    void merge(const DescriptionSketch& other);
+
+    std::size_t getCount() const { return count; }
+    double getDistinct() const { return distinct.estimate(); }
+    std::vector<std::pair<std::string, std::uint32_t>> getTopWords(std::size_t limit) const { return words.getTop(limit); }
+    std::vector<std::pair<std::string, std::uint32_t>> getTopPhrases(std::size_t limit) const { return phrases.getTop(limit); }
+
+private:
+    // Keeping more candidates than are reported makes the reported ones reliable.
+    static constexpr std::size_t candidateCount = 64;
+
+    std::size_t count = 0;
+    HyperLogLog distinct;
+    TopTerms words{candidateCount};
+    TopTerms phrases{candidateCount};
+};
@@ -0,0 +1,72 @@
+#include "timerwheel.h"
+
+#include <utility>
+
+void TimerWheel::schedule(std::int64_t due, std::uint32_t id) {
+    const std::int64_t delta = due - now;
+    if (delta <= 0) {
+        expired.push_back({due, id});
+        return;
+    }
+    // A timer goes to the lowest level whose span reaches it, in the slot of its
+    // minute at that level's resolution.
+    for (std::size_t level = 0; level < levelCount; level++) {
+        const int shift = static_cast<int>(level) * slotBits;
+        if (delta < (std::int64_t{1} << (shift + slotBits))) {
+            levels[level][static_cast<std::size_t>(due >> shift) & (slotCount - 1)].push_back({due, id});
+            return;
+        }
+    }
+    overflow.push_back({due, id});
+}
+
+void TimerWheel::cascade(Slot& slot) {
+    Slot timers = std::move(slot);
+    slot.clear();
+    for (const auto& timer : timers) {
+        schedule(timer.due, timer.id);
+    }
+}
+
+void TimerWheel::advance(std::int64_t to, std::vector<std::uint32_t>& fired) {
+    while (true) {
+        for (const auto& timer : expired) {
+            fired.push_back(timer.id);
+        }
+        expired.clear();
+        if (now >= to) {
+            return;
+        }
+        now++;
+
+        // Entering a new slot at a level brings its timers down, starting from the
+        // highest level that turned, so that they can fall through several levels.
+        std::size_t turned = 0;
+        while (turned + 1 < levelCount && ((now >> ((turned + 1) * slotBits)) << ((turned + 1) * slotBits)) == now) {
+            turned++;
+        }
+        if (turned + 1 == levelCount && ((now >> (levelCount * slotBits)) << (levelCount * slotBits)) == now) {
+            cascade(overflow);
+        }
+        for (std::size_t level = turned; level > 0; level--) {
+            const int shift = static_cast<int>(level) * slotBits;
+            cascade(levels[level][static_cast<std::size_t>(now >> shift) & (slotCount - 1)]);
+        }
+
+        auto& slot = levels[0][static_cast<std::size_t>(now) & (slotCount - 1)];
+        for (const auto& timer : slot) {
+            fired.push_back(timer.id);
+        }
+        slot.clear();
+    }
+}
+
+void TimerWheel::clear() {
+    for (auto& level : levels) {
+        for (auto& slot : level) {
+            slot.clear();
+        }
+    }
+    overflow.clear();
+    expired.clear();
+}
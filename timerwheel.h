@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// A hierarchical timer wheel with a resolution of one minute, for reminders.
+//
+// Level 0 has a slot for each of the next 64 minutes; each level above has 64
+// slots of 64 times the span of a slot below, so four levels cover about 32
+// years, and anything later waits in an overflow list. Scheduling a timer
+// appends it to one slot, whatever the number of timers. When the wheel turns
+// into a new slot of a higher level, that slot's timers are cascaded into the
+// levels below, so every timer moves at most once per level before it fires.
+class TimerWheel {
+public:
+    // Starts the wheel at `now`, a minute number (see event.h).
+    explicit TimerWheel(std::int64_t now) : now(now) {}
+
+    std::int64_t getNow() const { return now; }
+
+    // Schedules timer `id` to fire at minute `due`. A timer that is already due
+    // fires on the next `advance`.
+    void schedule(std::int64_t due, std::uint32_t id);
+
+    // Turns the wheel minute by minute up to `to`, appending the ids of the
+    // timers that fire to `fired`, in the order of their minutes.
+    void advance(std::int64_t to, std::vector<std::uint32_t>& fired);
+
+    // Drops all timers.
+    void clear();
+
+private:
+    static constexpr int slotBits = 6;
+    static constexpr std::size_t slotCount = std::size_t{1} << slotBits;
+    static constexpr std::size_t levelCount = 4;
+
+    struct Timer {
+        std::int64_t due;
+        std::uint32_t id;
+    };
+    using Slot = std::vector<Timer>;
+
+    // Moves the timers of `slot` to where they belong now.
+    void cascade(Slot& slot);
+
+    std::int64_t now;
+    std::array<std::array<Slot, slotCount>, levelCount> levels;
+    Slot overflow; // due after the last level
+    Slot expired;  // due at or before `now`, fired on the next turn
+};
@@ -0,0 +1,293 @@
+#include "wal.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::string_view magic{"DAYSWAL1"};
+constexpr std::size_t frameSize = 8; // length and checksum
+
+// The table for the bytewise CRC32C, of the reflected polynomial 0x82f63b78.
+constexpr std::array<std::uint32_t, 256> crcTable = []() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < 256; i++) {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+#if defined(__x86_64__)
+// SSE 4.2 has an instruction for CRC32C, eight bytes at a time.
+__attribute__((target("sse4.2"))) std::uint32_t getCrc32cHardware(std::string_view data, std::uint32_t crc) {
+    std::uint64_t value = crc;
+    std::size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data.data() + i, sizeof word);
+        value = __builtin_ia32_crc32di(value, word);
+    }
+    auto result = static_cast<std::uint32_t>(value);
+    for (; i < data.size(); i++) {
+        result = __builtin_ia32_crc32qi(result, static_cast<unsigned char>(data[i]));
+    }
+    return result;
+}
+#endif
+
+bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        const ssize_t count = write(fd, data.data(), data.size());
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(count));
+    }
+    return true;
+}
+
+std::string frame(LogRecordType type, std::string_view body) {
+    std::string payload;
+    payload.reserve(frameSize + 1 + body.size());
+    WireWriter writer(payload);
+    const auto length = static_cast<std::uint32_t>(body.size() + 1);
+    writer.u32(length);
+    writer.u32(0); // the checksum, filled in below
+    writer.u8(static_cast<std::uint8_t>(type));
+    writer.bytes(body);
+
+    std::uint32_t crc = getCrc32c(std::string_view(payload).substr(0, 4));
+    crc = getCrc32c(std::string_view(payload).substr(frameSize), crc);
+    std::string checksum;
+    WireWriter(checksum).u32(crc);
+    payload.replace(4, 4, checksum);
+    return payload;
+}
+
+// Reads the first `size` bytes of `fd`, or as many as there are.
+std::string readAll(int fd, std::uint64_t size) {
+    std::string data(size, '\0');
+    std::size_t read = 0;
+    while (read < data.size()) {
+        const ssize_t count = pread(fd, data.data() + read, data.size() - read, static_cast<off_t>(read));
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        read += static_cast<std::size_t>(count);
+    }
+    data.resize(read);
+    return data;
+}
+
+// Returns the complete records of the log `data`, setting `end` to where they end.
+std::vector<LogRecord> parseRecords(std::string_view data, std::size_t& end) {
+    std::vector<LogRecord> records;
+    std::size_t position = magic.size();
+    while (position <= data.size() && data.size() - position >= frameSize + 1) {
+        WireReader reader(data.substr(position));
+        const std::uint32_t length = reader.u32();
+        const std::uint32_t checksum = reader.u32();
+        if (length == 0 || length > data.size() - position - frameSize) {
+            break; // torn
+        }
+        const auto payload = data.substr(position + frameSize, length);
+        if (getCrc32c(payload, getCrc32c(data.substr(position, 4))) != checksum) {
+            break;
+        }
+        const auto type = static_cast<LogRecordType>(payload.front());
+        if (type != LogRecordType::Add && type != LogRecordType::Delete && type != LogRecordType::Checkpoint) {
+            break;
+        }
+        records.push_back({type, std::string(payload.substr(1))});
+        position += frameSize + length;
+    }
+    end = std::min(position, data.size());
+    return records;
+}
+
+} // namespace
+
+std::uint32_t getCrc32c(std::string_view data, std::uint32_t crc) {
+    crc = ~crc;
+#if defined(__x86_64__)
+    static const bool hasHardware = __builtin_cpu_supports("sse4.2");
+    if (hasHardware) {
+        return ~getCrc32cHardware(data, crc);
+    }
+#endif
+    for (unsigned char c : data) {
+        crc = (crc >> 8) ^ crcTable[(crc ^ c) & 0xff];
+    }
+    return ~crc;
+}
+
+std::string encodeCheckpoint(const FileStamp& stamp) {
+    std::string body;
+    WireWriter writer(body);
+    writer.u32(static_cast<std::uint32_t>(stamp.size));
+    writer.u32(static_cast<std::uint32_t>(stamp.size >> 32));
+    writer.u32(static_cast<std::uint32_t>(stamp.modified));
+    writer.u32(static_cast<std::uint32_t>(static_cast<std::uint64_t>(stamp.modified) >> 32));
+    return body;
+}
+
+std::optional<FileStamp> decodeCheckpoint(std::string_view body) {
+    WireReader reader(body);
+    FileStamp stamp;
+    stamp.size = reader.u32();
+    stamp.size |= static_cast<std::uint64_t>(reader.u32()) << 32;
+    std::uint64_t modified = reader.u32();
+    modified |= static_cast<std::uint64_t>(reader.u32()) << 32;
+    stamp.modified = static_cast<std::int64_t>(modified);
+    if (!reader.isValid() || reader.remaining() != 0) {
+        return std::nullopt;
+    }
+    return stamp;
+}
+
+std::unique_ptr<WriteAheadLog> WriteAheadLog::open(const std::filesystem::path& path, std::string& error, bool& busy) {
+    busy = false;
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = "unable to open " + path.string() + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        busy = errno == EWOULDBLOCK;
+        error = busy ? path.string() + " is in use by another process (is the daemon running?)"
+                     : "unable to lock " + path.string() + ": " + std::strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        error = "unable to read " + path.string() + ": " + std::strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    auto size = static_cast<std::uint64_t>(info.st_size);
+    if (size < magic.size()) {
+        // A new log, or one whose creation was cut short.
+        if (ftruncate(fd, 0) != 0 || !writeAll(fd, magic) || fsync(fd) != 0) {
+            error = "unable to write " + path.string() + ": " + std::strerror(errno);
+            close(fd);
+            return nullptr;
+        }
+        size = magic.size();
+    } else {
+        char header[magic.size()];
+        if (pread(fd, header, sizeof header, 0) != static_cast<ssize_t>(sizeof header) ||
+            std::string_view(header, sizeof header) != magic) {
+            error = path.string() + " is not a log of days";
+            close(fd);
+            return nullptr;
+        }
+    }
+    return std::unique_ptr<WriteAheadLog>(new WriteAheadLog(fd, size));
+}
+
+std::vector<LogRecord> WriteAheadLog::read(const std::filesystem::path& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info{};
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return {};
+    }
+    const std::string data = readAll(fd, static_cast<std::uint64_t>(info.st_size));
+    close(fd);
+    if (!data.starts_with(magic)) {
+        return {};
+    }
+    std::size_t end = 0;
+    return parseRecords(data, end);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close(fd);
+}
+
+std::vector<LogRecord> WriteAheadLog::recover(std::uint64_t& discarded) {
+    std::lock_guard lock(mutex);
+    const std::string data = readAll(fd, size);
+    std::size_t position = 0;
+    auto records = parseRecords(data, position);
+
+    discarded = size - position;
+    if (discarded > 0) {
+        if (ftruncate(fd, static_cast<off_t>(position)) != 0 || fsync(fd) != 0) {
+            failed = true;
+        }
+        size = position;
+    }
+    return records;
+}
+
+bool WriteAheadLog::append(LogRecordType type, std::string_view body) {
+    const std::string record = frame(type, body);
+    std::unique_lock lock(mutex);
+    if (failed) {
+        return false;
+    }
+    pending += record;
+    size += record.size();
+    const std::uint64_t sequence = ++appended;
+
+    // The first writer to find no sync under way syncs everything pending,
+    // its own record and those of the writers that queued up behind the last sync.
+    while (durable < sequence && !failed) {
+        if (syncing) {
+            synced.wait(lock);
+            continue;
+        }
+        syncing = true;
+        std::string batch;
+        batch.swap(pending);
+        const std::uint64_t batchEnd = appended;
+        lock.unlock();
+        const bool written = writeAll(fd, batch) && fdatasync(fd) == 0;
+        lock.lock();
+        syncing = false;
+        if (written) {
+            durable = batchEnd;
+        } else {
+            failed = true;
+        }
+        synced.notify_all();
+    }
+    return durable >= sequence;
+}
+
+bool WriteAheadLog::reset() {
+    std::unique_lock lock(mutex);
+    synced.wait(lock, [this] { return !syncing; });
+    if (failed || ftruncate(fd, static_cast<off_t>(magic.size())) != 0 || fsync(fd) != 0) {
+        failed = true;
+        return false;
+    }
+    size = magic.size();
+    return true;
+}
+
+std::uint64_t WriteAheadLog::getSize() const {
+    std::lock_guard lock(mutex);
+    return size - magic.size();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "filestamp.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The write-ahead log of the daemon, ~/.days/events.wal. The daemon logs its
+// adds and deletes here instead of writing events.csv, and folds the log into
+// events.csv (a checkpoint) once in a while; the events are events.csv with the
+// records of the log applied in order.
+//
+// After an 8-byte magic, each record is framed as
+//
+//     u32 length | u32 checksum | u8 type | body[length - 1]
+//
+// where the checksum is the CRC32C of the length and the type and body. A record
+// cut short by a crash, or one that doesn't check out, ends the log.
+
+enum class LogRecordType : std::uint8_t {
+    Add = 1,        // body: the events.csv row of the event
+    Delete = 2,     // body: the filter of the deleted events, serialized
+    Checkpoint = 3, // body: the stamp of the events file that has all records before it
+};
+
+struct LogRecord {
+    LogRecordType type;
+    std::string body;
+};
+
+// Returns the CRC32C (Castagnoli) of `data`, continuing from `crc`.
+std::uint32_t getCrc32c(std::string_view data, std::uint32_t crc = 0);
+
+// The body of a checkpoint record, and back.
+std::string encodeCheckpoint(const FileStamp& stamp);
+std::optional<FileStamp> decodeCheckpoint(std::string_view body);
+
+class WriteAheadLog {
+public:
+    // Opens the log at `path`, creating it if missing, and locks it so that no
+    // other process writes it while this one has it. Returns nullptr and sets
+    // `error` if it can't be opened; `busy` tells if another process has it.
+    static std::unique_ptr<WriteAheadLog> open(const std::filesystem::path& path, std::string& error, bool& busy);
+
+    // Reads the complete records of the log at `path` without locking it, for a
+    // process that only looks at the events while another one has the log.
+    static std::vector<LogRecord> read(const std::filesystem::path& path);
+
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Reads the complete records. A torn or corrupt tail is cut off the file, and
+    // `discarded` gets its size in bytes. Must not race with `append`.
+    std::vector<LogRecord> recover(std::uint64_t& discarded);
+
+    // Appends a record and returns once it is on disk. Records appended by other
+    // threads while a sync is under way go to disk together with the next one, so
+    // concurrent writers share their fsyncs. Returns false if the record can't be
+    // written; the log takes no more records after that.
+    bool append(LogRecordType type, std::string_view body);
+
+    // Empties the log, once its records have been folded into events.csv. Must
+    // not race with `append`.
+    bool reset();
+
+    // Returns the size of the records in bytes, including those being synced.
+    std::uint64_t getSize() const;
+
+private:
+    WriteAheadLog(int fd, std::uint64_t size) : fd(fd), size(size) {}
+
+    int fd;
+    mutable std::mutex mutex;
+    std::condition_variable synced;
+    std::uint64_t size;          // of the file, with `pending`
+    std::string pending;         // records waiting for the next sync
+    std::uint64_t appended = 0;  // number of records appended
+    std::uint64_t durable = 0;   // number of records on disk
+    bool syncing = false;
+    bool failed = false;
+};
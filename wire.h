@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Appends little-endian integers and length-prefixed strings to a byte buffer.
+class WireWriter {
+public:
+    explicit WireWriter(std::string& buffer) : buffer(buffer) {}
+
+    void u8(std::uint8_t value) { buffer.push_back(static_cast<char>(value)); }
+
+    void u16(std::uint16_t value) {
+        const char bytes[2] = {static_cast<char>(value & 0xff), static_cast<char>((value >> 8) & 0xff)};
+        buffer.append(bytes, sizeof bytes);
+    }
+
+    void u32(std::uint32_t value) {
+        const char bytes[4] = {
+            static_cast<char>(value & 0xff), static_cast<char>((value >> 8) & 0xff),
+            static_cast<char>((value >> 16) & 0xff), static_cast<char>((value >> 24) & 0xff)};
+        buffer.append(bytes, sizeof bytes);
+    }
+
+    void i32(std::int32_t value) { u32(static_cast<std::uint32_t>(value)); }
+
+    void string(std::string_view value) {
+        u32(static_cast<std::uint32_t>(value.size()));
+        buffer.append(value);
+    }
+
+    void bytes(std::string_view value) { buffer.append(value); }
+
+private:
+    std::string& buffer;
+};
+
+// Reads what `WireWriter` wrote. Reading past the end of the data doesn't throw;
+// it returns zeros and empty strings and makes `isValid()` false, so a decoder
+// can read a whole message and check once at the end.
+class WireReader {
+public:
+    explicit WireReader(std::string_view data) : data(data) {}
+
+    std::uint8_t u8() {
+        if (!take(1)) {
+            return 0;
+        }
+        return static_cast<std::uint8_t>(data[position - 1]);
+    }
+
+    std::uint16_t u16() {
+        if (!take(2)) {
+            return 0;
+        }
+        const auto* bytes = reinterpret_cast<const unsigned char*>(data.data() + position - 2);
+        return static_cast<std::uint16_t>(bytes[0] | (bytes[1] << 8));
+    }
+
+    std::uint32_t u32() {
+        if (!take(4)) {
+            return 0;
+        }
+        const auto* bytes = reinterpret_cast<const unsigned char*>(data.data() + position - 4);
+        return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<std::uint32_t>(bytes[3]) << 24);
+    }
+
+    std::int32_t i32() { return static_cast<std::int32_t>(u32()); }
+
+    std::string_view string() { return bytes(u32()); }
+
+    std::string_view bytes(std::size_t size) {
+        if (!take(size)) {
+            return {};
+        }
+        return data.substr(position - size, size);
+    }
+
+    std::size_t remaining() const { return data.size() - position; }
+    bool isValid() const { return valid; }
+
+private:
+    bool take(std::size_t size) {
+        if (!valid || data.size() - position < size) {
+            valid = false;
+            return false;
+        }
+        position += size;
+        return true;
+    }
+
+    std::string_view data;
+    std::size_t position = 0;
+    bool valid = true;
+};